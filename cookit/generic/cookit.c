@@ -8,6 +8,24 @@
 
 #include "cookit.h"
 #include <unistd.h> // for isatty()
+#include <stdlib.h> // for qsort()
+#include <string.h>
+
+#ifdef __WIN32__
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif /* __WIN32__ */
+
+#ifndef __WIN32__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif /* !__WIN32__ */
 
 static Tcl_Config const cookit_pkgconfig[] = {
     { "package-version",  PACKAGE_VERSION },
@@ -59,6 +77,791 @@ static int cookit_IsTtyCmd(ClientData clientData, Tcl_Interp *interp, int objc,
 
 }
 
+// The maximum number of phases that can be recorded in the startup profile.
+// Cookit_Startup() uses about a dozen of them.
+#define PROFILE_MAX_PHASES 32
+
+static struct {
+    int enabled;
+    int count;
+    Tcl_WideInt base;
+    Tcl_WideInt last;
+    struct {
+        const char *name;
+        Tcl_WideInt start;
+        Tcl_WideInt end;
+    } phases[PROFILE_MAX_PHASES];
+} cookit_profile = { 0 };
+
+// Returns the value of a monotonic clock in microseconds.
+static Tcl_WideInt cookit_ProfileNow(void) {
+#ifdef __WIN32__
+    static LARGE_INTEGER freq = { 0 };
+    LARGE_INTEGER count;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&count);
+    return (Tcl_WideInt)(count.QuadPart / freq.QuadPart * 1000000 +
+        count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(__APPLE__)
+    // clock_gettime() is not available on macOS before 10.12
+    static mach_timebase_info_data_t tb = { 0, 0 };
+    if (tb.denom == 0) {
+        mach_timebase_info(&tb);
+    }
+    return (Tcl_WideInt)(mach_absolute_time() * tb.numer / tb.denom / 1000);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (Tcl_WideInt)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif /* __WIN32__ */
+}
+
+void Cookit_ProfileStart(void) {
+    cookit_profile.enabled = 1;
+    cookit_profile.count = 0;
+    cookit_profile.base = cookit_profile.last = cookit_ProfileNow();
+}
+
+// Records the end of the phase. The phase starts where the previous one
+// ended. The name must be a static string.
+void Cookit_ProfileMark(const char *phase) {
+    if (!cookit_profile.enabled ||
+        cookit_profile.count >= PROFILE_MAX_PHASES)
+    {
+        return;
+    }
+    Tcl_WideInt now = cookit_ProfileNow();
+    int idx = cookit_profile.count++;
+    cookit_profile.phases[idx].name = phase;
+    cookit_profile.phases[idx].start = cookit_profile.last - cookit_profile.base;
+    cookit_profile.phases[idx].end = now - cookit_profile.base;
+    cookit_profile.last = now;
+}
+
+int Cookit_ProfileWrite(Tcl_Interp *interp, const char *filename) {
+
+    if (!cookit_profile.enabled) {
+        return TCL_OK;
+    }
+
+    Tcl_Obj *json = Tcl_NewStringObj("{\"unit\":\"us\",\"phases\":[", -1);
+    Tcl_IncrRefCount(json);
+    for (int i = 0; i < cookit_profile.count; i++) {
+        Tcl_AppendPrintfToObj(json, "%s{\"name\":\"%s\",\"start\":%"
+            TCL_LL_MODIFIER "d,\"end\":%" TCL_LL_MODIFIER "d}",
+            (i ? "," : ""), cookit_profile.phases[i].name,
+            cookit_profile.phases[i].start, cookit_profile.phases[i].end);
+    }
+    Tcl_AppendPrintfToObj(json, "],\"total\":%" TCL_LL_MODIFIER "d}\n",
+        cookit_profile.last - cookit_profile.base);
+
+    // The file name comes from the environment and is in the system encoding.
+    Tcl_DString ds;
+    Tcl_ExternalToUtfDString(NULL, filename, -1, &ds);
+    Tcl_Channel chan = Tcl_OpenFileChannel(interp, Tcl_DStringValue(&ds),
+        "w", 0666);
+    Tcl_DStringFree(&ds);
+
+    int result = TCL_ERROR;
+    if (chan != NULL) {
+        if (Tcl_WriteObj(chan, json) >= 0) {
+            result = TCL_OK;
+        }
+        if (Tcl_Close(interp, chan) != TCL_OK) {
+            result = TCL_ERROR;
+        }
+    }
+
+    Tcl_DecrRefCount(json);
+    return result;
+
+}
+
+int Cookit_ReadaheadExecutable(const char *filename, Tcl_WideInt offset,
+    Tcl_WideInt length)
+{
+#ifdef __linux__
+
+    if (offset < 0 || length <= 0) {
+        return TCL_ERROR;
+    }
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return TCL_ERROR;
+    }
+
+    // The range is read asynchronously into the page cache, which is
+    // shared with other processes that run the same executable. The read
+    // continues after the descriptor is closed.
+    int result = posix_fadvise(fd, (off_t)offset, (off_t)length,
+        POSIX_FADV_WILLNEED);
+    close(fd);
+
+    return (result == 0 ? TCL_OK : TCL_ERROR);
+
+#else
+    (void)filename;
+    (void)offset;
+    (void)length;
+    return TCL_ERROR;
+#endif /* __linux__ */
+}
+
+Tcl_Obj *Cookit_CacheDirGet(Tcl_Interp *interp) {
+
+    const char *cacheEnv = Tcl_GetVar2(interp, "env", "COOKIT_CACHE",
+        TCL_GLOBAL_ONLY);
+    if (cacheEnv == NULL || *cacheEnv == '\0' || strcmp(cacheEnv, "0") == 0) {
+        return NULL;
+    }
+
+    if (strcmp(cacheEnv, "1") != 0) {
+        return Tcl_NewStringObj(cacheEnv, -1);
+    }
+
+    // Use the default cache directory for the current platform
+#ifdef __WIN32__
+    const char *base = Tcl_GetVar2(interp, "env", "LOCALAPPDATA",
+        TCL_GLOBAL_ONLY);
+    if (base == NULL || *base == '\0') {
+        return NULL;
+    }
+    return Tcl_ObjPrintf("%s/cookit/cache", base);
+#else
+    const char *base = Tcl_GetVar2(interp, "env", "XDG_CACHE_HOME",
+        TCL_GLOBAL_ONLY);
+    if (base != NULL && *base != '\0') {
+        return Tcl_ObjPrintf("%s/cookit", base);
+    }
+    base = Tcl_GetVar2(interp, "env", "HOME", TCL_GLOBAL_ONLY);
+    if (base == NULL || *base == '\0') {
+        return NULL;
+    }
+    return Tcl_ObjPrintf("%s/.cache/cookit", base);
+#endif /* __WIN32__ */
+
+}
+
+// Returns the number of available CPUs
+static int cookit_CpuCount(void) {
+#ifdef __WIN32__
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif /* __WIN32__ */
+}
+
+static int cookit_CpuCountCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    (void)clientData;
+
+    if (objc != 1) {
+        Tcl_WrongNumArgs(interp, 1, objv, NULL);
+        return TCL_ERROR;
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(cookit_CpuCount()));
+    return TCL_OK;
+
+}
+
+// ::cookit::walk dir ?-pattern pattern? ?-stat?
+//
+// Returns files in the directory tree in the same order as
+// ::cookit::recursive_glob did: sorted files of the directory, then files
+// of its sorted subdirectories. Hidden files and directories are skipped
+// the same way as glob does. With -stat, returns a dictionary where keys
+// are files and directories, and values are lists of the type ("file" or
+// "directory"), size and modification time.
+
+typedef struct {
+    Tcl_Obj *result;
+    const char *pattern;
+    int isStat;
+} cookit_WalkState;
+
+typedef struct {
+    Tcl_Obj *name;
+#ifndef __WIN32__
+    char *native;
+#endif /* !__WIN32__ */
+    int isDirectory;
+    Tcl_WideInt size;
+    Tcl_WideInt mtime;
+} cookit_WalkEntry;
+
+static int cookit_WalkCompare(const void *a, const void *b) {
+    return strcmp(Tcl_GetString(((const cookit_WalkEntry *)a)->name),
+        Tcl_GetString(((const cookit_WalkEntry *)b)->name));
+}
+
+static void cookit_WalkAdd(cookit_WalkState *state, Tcl_Obj *path,
+    cookit_WalkEntry *entry)
+{
+    if (!state->isStat) {
+        if (!entry->isDirectory) {
+            Tcl_ListObjAppendElement(NULL, state->result, path);
+        }
+        return;
+    }
+    Tcl_Obj *stat[3];
+    stat[0] = Tcl_NewStringObj(entry->isDirectory ? "directory" : "file", -1);
+    stat[1] = Tcl_NewWideIntObj(entry->size);
+    stat[2] = Tcl_NewWideIntObj(entry->mtime);
+    Tcl_ListObjAppendElement(NULL, state->result, path);
+    Tcl_ListObjAppendElement(NULL, state->result, Tcl_NewListObj(3, stat));
+}
+
+static void cookit_WalkFree(cookit_WalkEntry *entries, Tcl_Size count) {
+    for (Tcl_Size i = 0; i < count; i++) {
+        Tcl_DecrRefCount(entries[i].name);
+#ifndef __WIN32__
+        if (entries[i].native != NULL) {
+            Tcl_Free(entries[i].native);
+        }
+#endif /* !__WIN32__ */
+    }
+    if (entries != NULL) {
+        Tcl_Free((char *)entries);
+    }
+}
+
+static int cookit_WalkGeneric(Tcl_Interp *interp, cookit_WalkState *state,
+    Tcl_Obj *dir);
+
+#ifndef __WIN32__
+
+// Walks the directory in the native filesystem. Directory entries are read
+// once by readdir() and their types are taken from the entries or from
+// fstatat() relative to the directory, without building full paths.
+static int cookit_WalkNative(Tcl_Interp *interp, cookit_WalkState *state,
+    Tcl_Obj *dir, const char *native)
+{
+
+    DIR *dh = opendir(native);
+    if (dh == NULL) {
+        // The same as glob -nocomplain
+        return TCL_OK;
+    }
+
+    cookit_WalkEntry *entries = NULL;
+    Tcl_Size count = 0;
+    Tcl_Size size = 0;
+    int result = TCL_OK;
+
+    struct dirent *de;
+    while ((de = readdir(dh)) != NULL) {
+
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        int isDirectory;
+        struct stat sb;
+        int isStatDone = 0;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (!state->isStat && de->d_type == DT_REG) {
+            isDirectory = 0;
+        } else if (!state->isStat && de->d_type == DT_DIR) {
+            isDirectory = 1;
+        } else
+#endif /* _DIRENT_HAVE_D_TYPE */
+        {
+            // Follow symlinks the same way as glob -type does
+            if (fstatat(dirfd(dh), de->d_name, &sb, 0) != 0) {
+                continue;
+            }
+            if (S_ISREG(sb.st_mode)) {
+                isDirectory = 0;
+            } else if (S_ISDIR(sb.st_mode)) {
+                isDirectory = 1;
+            } else {
+                continue;
+            }
+            isStatDone = 1;
+        }
+
+        Tcl_DString ds;
+        Tcl_ExternalToUtfDString(NULL, de->d_name, -1, &ds);
+
+        if (!isDirectory && !Tcl_StringMatch(Tcl_DStringValue(&ds),
+            state->pattern))
+        {
+            Tcl_DStringFree(&ds);
+            continue;
+        }
+
+        if (count == size) {
+            size = (size == 0 ? 64 : size * 2);
+            entries = (cookit_WalkEntry *)Tcl_Realloc((char *)entries,
+                sizeof(cookit_WalkEntry) * size);
+        }
+
+        cookit_WalkEntry *entry = &entries[count++];
+        entry->name = Tcl_NewStringObj(Tcl_DStringValue(&ds),
+            Tcl_DStringLength(&ds));
+        Tcl_IncrRefCount(entry->name);
+        Tcl_DStringFree(&ds);
+        entry->isDirectory = isDirectory;
+        entry->size = (isStatDone && !isDirectory) ? (Tcl_WideInt)sb.st_size : 0;
+        entry->mtime = isStatDone ? (Tcl_WideInt)sb.st_mtime : 0;
+        entry->native = NULL;
+        if (isDirectory) {
+            size_t len = strlen(native);
+            entry->native = Tcl_Alloc(len + strlen(de->d_name) + 2);
+            memcpy(entry->native, native, len);
+            entry->native[len] = '/';
+            strcpy(entry->native + len + 1, de->d_name);
+        }
+
+    }
+
+    closedir(dh);
+
+    if (count > 1) {
+        qsort(entries, count, sizeof(cookit_WalkEntry), cookit_WalkCompare);
+    }
+
+    // Files first, then subdirectories
+    for (int pass = 0; pass < 2; pass++) {
+        for (Tcl_Size i = 0; i < count; i++) {
+            if (entries[i].isDirectory != pass) {
+                continue;
+            }
+            Tcl_Obj *path = Tcl_FSJoinToPath(dir, 1, &entries[i].name);
+            Tcl_IncrRefCount(path);
+            cookit_WalkAdd(state, path, &entries[i]);
+            if (pass) {
+                result = cookit_WalkNative(interp, state, path,
+                    entries[i].native);
+            }
+            Tcl_DecrRefCount(path);
+            if (result != TCL_OK) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    cookit_WalkFree(entries, count);
+    return result;
+
+}
+
+#endif /* !__WIN32__ */
+
+// Walks the directory in any filesystem, e.g. in mounted VFS
+static int cookit_WalkGeneric(Tcl_Interp *interp, cookit_WalkState *state,
+    Tcl_Obj *dir)
+{
+
+    cookit_WalkEntry *entries = NULL;
+    Tcl_Size count = 0;
+    int result = TCL_ERROR;
+    Tcl_StatBuf *sb = Tcl_AllocStatBuf();
+
+    Tcl_Obj *found[2] = { Tcl_NewListObj(0, NULL), Tcl_NewListObj(0, NULL) };
+    Tcl_IncrRefCount(found[0]);
+    Tcl_IncrRefCount(found[1]);
+
+    Tcl_GlobTypeData types[2] = {
+        { TCL_GLOB_TYPE_FILE, 0, NULL, NULL },
+        { TCL_GLOB_TYPE_DIR, 0, NULL, NULL }
+    };
+
+    if (Tcl_FSMatchInDirectory(interp, found[0], dir, state->pattern,
+        &types[0]) != TCL_OK || Tcl_FSMatchInDirectory(interp, found[1], dir,
+        "*", &types[1]) != TCL_OK)
+    {
+        goto done;
+    }
+
+    Tcl_Size fileCount, dirCount;
+    Tcl_Obj **files, **dirs;
+    Tcl_ListObjGetElements(NULL, found[0], &fileCount, &files);
+    Tcl_ListObjGetElements(NULL, found[1], &dirCount, &dirs);
+
+    if (fileCount + dirCount == 0) {
+        result = TCL_OK;
+        goto done;
+    }
+
+    entries = (cookit_WalkEntry *)Tcl_Alloc(sizeof(cookit_WalkEntry) *
+        (fileCount + dirCount));
+
+    for (Tcl_Size i = 0; i < fileCount + dirCount; i++) {
+        cookit_WalkEntry *entry = &entries[count++];
+        // Full paths are returned by Tcl_FSMatchInDirectory. They have
+        // the same prefix and can be sorted as is.
+        entry->name = (i < fileCount ? files[i] : dirs[i - fileCount]);
+        Tcl_IncrRefCount(entry->name);
+#ifndef __WIN32__
+        entry->native = NULL;
+#endif /* !__WIN32__ */
+        entry->isDirectory = (i >= fileCount);
+        entry->size = 0;
+        entry->mtime = 0;
+        if (state->isStat && Tcl_FSStat(entry->name, sb) == 0) {
+            if (!entry->isDirectory) {
+                entry->size = (Tcl_WideInt)Tcl_GetSizeFromStat(sb);
+            }
+            entry->mtime = (Tcl_WideInt)Tcl_GetModificationTimeFromStat(sb);
+        }
+    }
+
+    if (fileCount > 1) {
+        qsort(entries, fileCount, sizeof(cookit_WalkEntry), cookit_WalkCompare);
+    }
+    if (dirCount > 1) {
+        qsort(entries + fileCount, dirCount, sizeof(cookit_WalkEntry),
+            cookit_WalkCompare);
+    }
+
+    for (Tcl_Size i = 0; i < count; i++) {
+        cookit_WalkAdd(state, entries[i].name, &entries[i]);
+        if (entries[i].isDirectory &&
+            cookit_WalkGeneric(interp, state, entries[i].name) != TCL_OK)
+        {
+            goto done;
+        }
+    }
+
+    result = TCL_OK;
+
+done:
+    cookit_WalkFree(entries, count);
+    Tcl_DecrRefCount(found[0]);
+    Tcl_DecrRefCount(found[1]);
+    Tcl_Free((char *)sb);
+    return result;
+
+}
+
+static int cookit_WalkCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    (void)clientData;
+
+    static const char *const options[] = { "-pattern", "-stat", NULL };
+    enum options { OPT_PATTERN, OPT_STAT };
+
+    if (objc < 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "dir ?-pattern pattern? ?-stat?");
+        return TCL_ERROR;
+    }
+
+    cookit_WalkState state;
+    state.pattern = "*";
+    state.isStat = 0;
+
+    for (int i = 2; i < objc; i++) {
+        int idx;
+        if (Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0,
+            &idx) != TCL_OK)
+        {
+            return TCL_ERROR;
+        }
+        switch ((enum options) idx) {
+        case OPT_PATTERN:
+            if (++i == objc) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("missing value for"
+                    " argument '%s'", Tcl_GetString(objv[i - 1])));
+                return TCL_ERROR;
+            }
+            state.pattern = Tcl_GetString(objv[i]);
+            break;
+        case OPT_STAT:
+            state.isStat = 1;
+            break;
+        }
+    }
+
+    state.result = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(state.result);
+
+    int result;
+#ifndef __WIN32__
+    // Tcl_FSGetNativePath() returns NULL if the path is not in the native
+    // filesystem
+    const char *native = Tcl_FSGetNativePath(objv[1]);
+    if (native != NULL) {
+        result = cookit_WalkNative(interp, &state, objv[1], native);
+    } else
+#endif /* !__WIN32__ */
+    result = cookit_WalkGeneric(interp, &state, objv[1]);
+
+    if (result == TCL_OK) {
+        Tcl_SetObjResult(interp, state.result);
+    }
+    Tcl_DecrRefCount(state.result);
+    return result;
+
+}
+
+#ifdef TCL_THREADS
+
+// The maximum number of preload threads
+#define PRELOAD_MAX_THREADS 8
+
+// The list of startup files created by ::cookit::relayout
+#define PRELOAD_MANIFEST "cookit-startup.txt"
+
+typedef struct {
+    const char *root;
+    // The list of file names to read. They point to the manifest data.
+    char **files;
+    int count;
+} cookit_PreloadJob;
+
+static struct {
+    int count;
+    Tcl_ThreadId threads[PRELOAD_MAX_THREADS];
+    cookit_PreloadJob jobs[PRELOAD_MAX_THREADS];
+    char *data;
+    char **files;
+    // The number of files given to the threads, and the number of files
+    // that have been read completely. They are reported by
+    // ::cookit::preload_status.
+    int total;
+    int done;
+} cookit_preload = { 0 };
+
+TCL_DECLARE_MUTEX(cookit_preloadMutex);
+
+static Tcl_ThreadCreateType cookit_PreloadThread(ClientData clientData) {
+
+    cookit_PreloadJob *job = (cookit_PreloadJob *)clientData;
+
+    char *buffer = Tcl_Alloc(65536);
+
+    for (int i = 0; i < job->count; i++) {
+
+        Tcl_Obj *path = Tcl_NewStringObj(job->root, -1);
+        Tcl_AppendToObj(path, job->files[i], -1);
+        Tcl_IncrRefCount(path);
+
+        // We don't need the content of the file. Reading it
+        // decompresses its pages into the shared page cache.
+        Tcl_Channel chan = Tcl_FSOpenFileChannel(NULL, path, "rb", 0);
+        if (chan != NULL) {
+            while (Tcl_Read(chan, buffer, 65536) > 0) {}
+            if (Tcl_Eof(chan)) {
+                Tcl_MutexLock(&cookit_preloadMutex);
+                cookit_preload.done++;
+                Tcl_MutexUnlock(&cookit_preloadMutex);
+            }
+            Tcl_Close(NULL, chan);
+        }
+
+        Tcl_DecrRefCount(path);
+
+    }
+
+    Tcl_Free(buffer);
+
+    Tcl_ExitThread(TCL_OK);
+    TCL_THREAD_CREATE_RETURN;
+
+}
+
+static void cookit_PreloadFinalize(ClientData clientData) {
+
+    (void)clientData;
+
+    for (int i = 0; i < cookit_preload.count; i++) {
+        int result;
+        Tcl_JoinThread(cookit_preload.threads[i], &result);
+    }
+    cookit_preload.count = 0;
+
+    if (cookit_preload.files != NULL) {
+        Tcl_Free((char *)cookit_preload.files);
+        cookit_preload.files = NULL;
+    }
+
+    if (cookit_preload.data != NULL) {
+        Tcl_Free(cookit_preload.data);
+        cookit_preload.data = NULL;
+    }
+
+}
+
+void Cookit_PreloadStart(const char *root) {
+
+    if (cookit_preload.data != NULL) {
+        return;
+    }
+
+    // Background threads are useful only if there are other CPUs
+    // besides the one the main thread is running on.
+    int threads = cookit_CpuCount() - 1;
+    if (threads < 1) {
+        return;
+    }
+    if (threads > PRELOAD_MAX_THREADS) {
+        threads = PRELOAD_MAX_THREADS;
+    }
+
+    Tcl_Obj *manifest = Tcl_NewStringObj(root, -1);
+    Tcl_AppendToObj(manifest, PRELOAD_MANIFEST, -1);
+    Tcl_IncrRefCount(manifest);
+    Tcl_Channel chan = Tcl_FSOpenFileChannel(NULL, manifest, "r", 0);
+    Tcl_DecrRefCount(manifest);
+    if (chan == NULL) {
+        return;
+    }
+    Tcl_SetChannelOption(NULL, chan, "-encoding", "utf-8");
+
+    Tcl_Obj *dataObj = Tcl_NewObj();
+    Tcl_IncrRefCount(dataObj);
+    Tcl_ReadChars(chan, dataObj, -1, 0);
+    Tcl_Close(NULL, chan);
+
+    Tcl_Size size;
+    const char *dataStr = Tcl_GetStringFromObj(dataObj, &size);
+
+    // Split the manifest into lines. The lines are terminated in place
+    // and are used as file names by the threads.
+    char *data = Tcl_Alloc(size + 1);
+    memcpy(data, dataStr, size);
+    data[size] = '\0';
+    Tcl_DecrRefCount(dataObj);
+
+    int count = 0;
+    for (Tcl_Size i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            count++;
+        }
+    }
+    count++;
+
+    char **files = (char **)Tcl_Alloc(sizeof(char *) * count);
+    count = 0;
+    for (char *line = data; line != NULL; ) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        if (*line != '\0') {
+            files[count++] = line;
+        }
+        line = next;
+    }
+
+    if (count == 0) {
+        Tcl_Free((char *)files);
+        Tcl_Free(data);
+        return;
+    }
+
+    cookit_preload.data = data;
+    cookit_preload.files = files;
+
+    if (threads > count) {
+        threads = count;
+    }
+
+    // The files are stored in the manifest in the order of their pages.
+    // Give each thread a contiguous part of the list, so that different
+    // threads decompress different pages.
+    int start = 0;
+    for (int i = 0; i < threads; i++) {
+        int end = (int)((Tcl_WideInt)count * (i + 1) / threads);
+        cookit_PreloadJob *job = &cookit_preload.jobs[cookit_preload.count];
+        job->root = root;
+        job->files = files + start;
+        job->count = end - start;
+        start = end;
+        // The counter is updated before the thread is started, since
+        // the thread can finish its job before Tcl_CreateThread returns.
+        Tcl_MutexLock(&cookit_preloadMutex);
+        cookit_preload.total += job->count;
+        Tcl_MutexUnlock(&cookit_preloadMutex);
+        if (Tcl_CreateThread(&cookit_preload.threads[cookit_preload.count],
+            cookit_PreloadThread, job, TCL_THREAD_STACK_DEFAULT,
+            TCL_THREAD_JOINABLE) == TCL_OK)
+        {
+            cookit_preload.count++;
+        } else {
+            Tcl_MutexLock(&cookit_preloadMutex);
+            cookit_preload.total -= job->count;
+            Tcl_MutexUnlock(&cookit_preloadMutex);
+        }
+    }
+
+    Tcl_CreateExitHandler(cookit_PreloadFinalize, NULL);
+
+}
+
+#endif /* TCL_THREADS */
+
+// ::cookit::preload_status
+//
+// Returns a dictionary with the number of preload threads started at
+// startup, the number of files given to them and the number of files that
+// have been read completely. All values are 0 if files were not preloaded.
+static int cookit_PreloadStatusCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    (void)clientData;
+
+    if (objc != 1) {
+        Tcl_WrongNumArgs(interp, 1, objv, NULL);
+        return TCL_ERROR;
+    }
+
+    int threads = 0;
+    int total = 0;
+    int done = 0;
+#ifdef TCL_THREADS
+    Tcl_MutexLock(&cookit_preloadMutex);
+    threads = cookit_preload.count;
+    total = cookit_preload.total;
+    done = cookit_preload.done;
+    Tcl_MutexUnlock(&cookit_preloadMutex);
+#endif /* TCL_THREADS */
+
+    Tcl_Obj *result = Tcl_NewDictObj();
+    Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("threads", -1),
+        Tcl_NewIntObj(threads));
+    Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("files", -1),
+        Tcl_NewIntObj(total));
+    Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("done", -1),
+        Tcl_NewIntObj(done));
+
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+
+}
+
+static int cookit_StartupProfileCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    (void)clientData;
+
+    if (objc != 1) {
+        Tcl_WrongNumArgs(interp, 1, objv, NULL);
+        return TCL_ERROR;
+    }
+
+    Tcl_Obj *result = Tcl_NewDictObj();
+    for (int i = 0; i < cookit_profile.count; i++) {
+        Tcl_Obj *times[2];
+        times[0] = Tcl_NewWideIntObj(cookit_profile.phases[i].start);
+        times[1] = Tcl_NewWideIntObj(cookit_profile.phases[i].end);
+        Tcl_DictObjPut(NULL, result,
+            Tcl_NewStringObj(cookit_profile.phases[i].name, -1),
+            Tcl_NewListObj(2, times));
+    }
+
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+
+}
 
 #if TCL_MAJOR_VERSION > 8
 #define MIN_TCL_VERSION "9.0"
@@ -73,6 +876,10 @@ DLLEXPORT int Cookit_Init(Tcl_Interp *interp)  {
     }
 
     Tcl_CreateObjCommand(interp, "::cookit::is_tty", cookit_IsTtyCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "::cookit::startup_profile", cookit_StartupProfileCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "::cookit::cpucount", cookit_CpuCountCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "::cookit::walk", cookit_WalkCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "::cookit::preload_status", cookit_PreloadStatusCmd, NULL, NULL);
 
     Tcl_RegisterConfig(interp, PACKAGE_NAME, cookit_pkgconfig, "iso8859-1");
 
@@ -11,7 +11,39 @@
 
 #include <tcl.h>
 
+#ifndef TCL_SIZE_MAX
+#ifndef Tcl_Size
+typedef int Tcl_Size;
+#endif /* Tcl_Size */
+#define TCL_SIZE_MAX INT_MAX
+#endif /* TCL_SIZE_MAX */
+
 DLLEXPORT int Cookit_Init(Tcl_Interp *interp);
 
+// Startup profile. It is enabled by the COOKIT_PROFILE environment variable
+// and is filled by Cookit_Startup() in main.c.
+void Cookit_ProfileStart(void);
+void Cookit_ProfileMark(const char *phase);
+int Cookit_ProfileWrite(Tcl_Interp *interp, const char *filename);
+
+// Asks the kernel to read the specified range of the root executable ahead
+// into the page cache. It is used by Cookit_Startup() for the pages of
+// startup files when the COOKIT_READAHEAD environment variable is "1".
+// Returns TCL_ERROR on platforms other than Linux.
+int Cookit_ReadaheadExecutable(const char *filename, Tcl_WideInt offset,
+    Tcl_WideInt length);
+
+// Persistent cache of the root VFS. Returns the cache directory, or NULL if
+// the cache is not enabled by the COOKIT_CACHE environment variable.
+// The returned object has zero reference count.
+Tcl_Obj *Cookit_CacheDirGet(Tcl_Interp *interp);
+
+#ifdef TCL_THREADS
+// Starts background threads that read files listed in cookit-startup.txt
+// in the specified VFS to decompress their pages into the shared page cache.
+// The threads are joined when Tcl is finalized.
+void Cookit_PreloadStart(const char *root);
+#endif /* TCL_THREADS */
+
 #endif /* COOKIT_H */
 
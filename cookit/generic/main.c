@@ -29,13 +29,6 @@
 #include <tchar.h>
 #endif
 
-#ifndef TCL_SIZE_MAX
-#ifndef Tcl_Size
-typedef int Tcl_Size;
-#endif /* Tcl_Size */
-#define TCL_SIZE_MAX INT_MAX
-#endif /* TCL_SIZE_MAX */
-
 #if defined(__MINGW32__)
 int _CRT_glob = 0;
 #endif /* __MINGW32__ */
@@ -67,6 +60,13 @@ int _CRT_glob = 0;
 int g_isConsoleMode;
 #endif /* COOKIT_CONSOLE_ONLY */
 int g_isBootstrap;
+// The file name for the startup profile in JSON format, or NULL if
+// profiling is disabled.
+const char *g_profileFile = NULL;
+// 1 - the range of the root executable with pages of startup files is read
+// ahead into the page cache at startup. It is enabled on Linux by setting
+// the COOKIT_READAHEAD environment variable to "1".
+int g_isReadaheadEnabled = 0;
 
 int g_argc = 0;
 #ifdef __WIN32__
@@ -91,20 +91,159 @@ Tcl_AppInitProc Twapi_base_Init;
 
 void TclX_IdInit (Tcl_Interp *interp);
 
+// The lambda that records files from the root VFS used by the application
+// at startup. It is used by ::cookit::relayout to place these files in
+// the first pages. It is enabled only if the COOKIT_TRACE environment
+// variable matches the cookit.trace metadata of the root VFS. This metadata
+// is set by ::cookit::relayout for the run and is not present in the final
+// executable. Thus, released executables ignore COOKIT_TRACE. Files are
+// recorded when they are read by the source, open and load commands. Startup
+// is considered complete when the application enters the event loop or exits.
+static const char *trace_lambda =
+    "{ file root } {\n"
+    "    set fh [open $file w]\n"
+    "    fconfigure $fh -buffering line -encoding utf-8 -translation lf\n"
+    "    foreach cmd { source open load } {\n"
+    "        trace add execution $cmd enter [list ::apply {{ fh root command op } {\n"
+    "            if { [namespace tail [lindex $command 0]] eq \"source\" } {\n"
+    "                set path [lindex $command end]\n"
+    "            } else {\n"
+    "                set path [lindex $command 1]\n"
+    "            }\n"
+    "            if { $path eq \"\" || [catch { file normalize $path } path] } return\n"
+    "            if { [string first $root $path] != 0 } return\n"
+    "            set path [string range $path [string length $root] end]\n"
+    "            if { [info exists ::cookit::traced($path)] } return\n"
+    "            set ::cookit::traced($path) 1\n"
+    "            puts $fh $path\n"
+    "        }} $fh $root]\n"
+    "    }\n"
+    "    after idle exit\n"
+    "}\n";
+
+// Checks the persistent cache of the root VFS. Returns "mount <file>" if
+// the cache file for this build of the executable exists and can be
+// mounted instead of the executable, "build <file>" if this process is
+// started to create the cache file, or an empty string. If the cache file
+// doesn't exist yet, then this lambda starts the executable in the background
+// with the COOKIT_CACHE_BUILD environment variable to create it.
+//
+// The cache file name contains the checksum of the executable content,
+// which is stored in the VFS metadata by ::cookit::wrap. The cache content
+// is executed, so the cache directory and the cache file must be owned by
+// the current user and must not be writable by other users.
+static const char *cache_lambda =
+    "{ dir exe handle } {\n"
+    "    set build [info exists ::env(COOKIT_CACHE_BUILD)]\n"
+    "    unset -nocomplain ::env(COOKIT_CACHE_BUILD)\n"
+    "    set id [$handle getmetadata cookit.id \"\"]\n"
+    "    if { $id eq \"\" } return\n"
+    "    set file [file join $dir [format %08x-%s.cfs\\\n"
+    "        [zlib crc32 [file normalize $exe]] $id]]\n"
+    "    set unix [expr { $::tcl_platform(platform) ne \"windows\" }]\n"
+    "    if { ![file isdirectory $dir] } {\n"
+    "        if { $build || [catch { file mkdir $dir }] } return\n"
+    "        if { $unix } { file attributes $dir -permissions 0o700 }\n"
+    "    }\n"
+    "    if { $unix } {\n"
+    "        foreach path [list $dir $file] {\n"
+    "            if { ![file exists $path] } continue\n"
+    "            if { [file attributes $path -owner] ne $::tcl_platform(user)\n"
+    "                || [scan [file attributes $path -permissions] %o] & 0o022 } return\n"
+    "        }\n"
+    "    }\n"
+    "    if { $build } { return [list build $file] }\n"
+    "    if { [file isfile $file] } { return [list mount $file] }\n"
+    "    if { [file exists $file.failed] || ![file writable $dir] } return\n"
+    "    if { [file exists $file.lock]\n"
+    "        && [clock seconds] - [file mtime $file.lock] < 600 } return\n"
+    "    set ::env(COOKIT_CACHE_BUILD) 1\n"
+    "    catch { exec $exe << {} >& [expr { $unix ? \"/dev/null\" : \"NUL\" }] & }\n"
+    "    unset ::env(COOKIT_CACHE_BUILD)\n"
+    "    return\n"
+    "}\n";
+
 #if TCL_MAJOR_VERSION > 8
 #define MIN_VERSION "9.0"
 #else
 #define MIN_VERSION "8.6"
 #endif
 
+// Mounts the specified file as the root VFS. Returns 1 if the file is
+// mounted and 0 otherwise. If handlePtr is not NULL, then the handle of
+// the mounted VFS is stored there with incremented reference count.
+static int mount_root(Tcl_Interp *interp, Tcl_Obj *file, Tcl_Obj *local,
+    void *props, Tcl_Obj **handlePtr)
+{
+
+    // The page cache size for the root VFS can be changed by
+    // the COOKIT_PAGECACHE environment variable. It is not available
+    // in VFS properties, and Cookfs_Mount() doesn't return the handle of
+    // the mounted VFS. Thus, mount the root VFS with the ::cookfs::Mount
+    // command in these cases. If it fails, mount the root VFS in the usual
+    // way.
+    Tcl_Obj *pageCacheSize = Tcl_GetVar2Ex(interp, "env", "COOKIT_PAGECACHE",
+        TCL_GLOBAL_ONLY);
+    int pageCacheSizeInt;
+    int isPageCacheSize = (pageCacheSize != NULL &&
+        Tcl_GetIntFromObj(NULL, pageCacheSize, &pageCacheSizeInt) == TCL_OK &&
+        pageCacheSizeInt >= 0);
+    if (isPageCacheSize || handlePtr != NULL) {
+        Tcl_Obj *objv[] = {
+            Tcl_NewStringObj("::cookfs::Mount", -1),
+            Tcl_NewStringObj("-readonly", -1),
+            Tcl_NewStringObj("-volume", -1),
+#ifdef TCL_THREADS
+            Tcl_NewStringObj("-shared", -1),
+#endif /* TCL_THREADS */
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]), objv);
+        Tcl_IncrRefCount(cmd);
+        if (isPageCacheSize) {
+            DBG("mount_root: mount root vfs with page cache size: %d",
+                pageCacheSizeInt);
+            Tcl_ListObjAppendElement(NULL, cmd,
+                Tcl_NewStringObj("-pagecachesize", -1));
+            Tcl_ListObjAppendElement(NULL, cmd,
+                Tcl_NewIntObj(pageCacheSizeInt));
+        }
+        Tcl_ListObjAppendElement(NULL, cmd, file);
+        Tcl_ListObjAppendElement(NULL, cmd, local);
+        int result = Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL);
+        Tcl_DecrRefCount(cmd);
+        if (result == TCL_OK && handlePtr != NULL) {
+            *handlePtr = Tcl_GetObjResult(interp);
+            Tcl_IncrRefCount(*handlePtr);
+        }
+        Tcl_ResetResult(interp);
+        if (result == TCL_OK) {
+            if (isPageCacheSize) {
+                Tcl_SetVar2Ex(interp, "::cookit::pagecachesize", NULL,
+                    Tcl_NewIntObj(pageCacheSizeInt), TCL_GLOBAL_ONLY);
+            }
+            return 1;
+        }
+    }
+
+    DBG("mount_root: mount root vfs");
+    if (Cookfs_Mount(interp, file, local, props) == TCL_OK) {
+        return 1;
+    }
+
+    return 0;
+
+}
+
 static int Cookit_Startup(Tcl_Interp *interp) {
 
     DBG("Cookit_Startup: ENTER to interp: %p", (void *)interp);
+    Cookit_ProfileMark("tcl_main");
 
     if (Tcl_InitStubs(interp, MIN_VERSION, 0) == NULL) {
         DBG("Cookit_Startup: failed to init stubs");
         return TCL_ERROR;
     }
+    Cookit_ProfileMark("stubs");
 
     // Make sure that we have stdout/stderr/stdin channels. Initialize them
     // to /dev/null if we don't have any. This will prevent Tcl from crashing
@@ -149,6 +288,7 @@ static int Cookit_Startup(Tcl_Interp *interp) {
 #ifndef COOKIT_CONSOLE_ONLY
     }
 #endif /* COOKIT_CONSOLE_ONLY */
+    Cookit_ProfileMark("channels");
 
     // Tcl_Main can break $argv by deciding that the user has specified
     // a startup script in it. In this case, Tcl_Main sets $::argv0 to the value
@@ -216,6 +356,7 @@ static int Cookit_Startup(Tcl_Interp *interp) {
     // Reset the start script, from a possible AI-based detection in Tcl_Main.
     // If necessary, we will set the desired value later.
     Tcl_SetStartupScript(NULL, NULL);
+    Cookit_ProfileMark("argv");
 
     // Init TclX
     TclX_IdInit(interp);
@@ -242,6 +383,8 @@ static int Cookit_Startup(Tcl_Interp *interp) {
     Tcl_StaticPackage(0, "Twapi_base", Twapi_base_Init, NULL);
 #endif /* __WIN32__ */
 
+    Cookit_ProfileMark("packages");
+
     Tcl_Obj *local = Tcl_NewStringObj(VFS_MOUNT, -1);
     Tcl_IncrRefCount(local);
 
@@ -255,6 +398,7 @@ static int Cookit_Startup(Tcl_Interp *interp) {
         DBG("Cookit_Startup: ERROR");
         goto error;
     }
+    Cookit_ProfileMark("cookfs_init");
 
     void *props = Cookfs_VfsPropsInit();
     Cookfs_VfsPropSetVolume(props, 1);
@@ -262,10 +406,165 @@ static int Cookit_Startup(Tcl_Interp *interp) {
 #ifdef TCL_THREADS
     Cookfs_VfsPropSetShared(props, 1);
 #endif /* TCL_THREADS */
-    DBG("Cookit_Startup: mount root vfs");
-    int isVFSAvailable = Cookfs_Mount(interp, exename, local, props) == TCL_OK
-        ? 1 : 0;
+    int isVFSAvailable = 0;
+
+    // The persistent cache is enabled by the COOKIT_CACHE environment
+    // variable, file tracing is requested by the COOKIT_TRACE environment
+    // variable, and readahead is enabled by COOKIT_READAHEAD. In these cases,
+    // the handle of the root VFS is needed to get the checksum of
+    // the executable, the trace file or the startup range from its
+    // metadata. COOKIT_TRACE is removed from the environment, so it is not
+    // inherited by child processes.
+    Tcl_Obj *cacheDir = Cookit_CacheDirGet(interp);
+    Tcl_Obj *cacheFile = NULL;
+    Tcl_Obj *handle = NULL;
+    if (cacheDir != NULL) {
+        Tcl_IncrRefCount(cacheDir);
+    }
+    Tcl_Obj *traceFile = Tcl_GetVar2Ex(interp, "env", "COOKIT_TRACE",
+        TCL_GLOBAL_ONLY);
+    if (traceFile != NULL) {
+        Tcl_IncrRefCount(traceFile);
+        Tcl_UnsetVar2(interp, "env", "COOKIT_TRACE", TCL_GLOBAL_ONLY);
+    }
+
+    isVFSAvailable = mount_root(interp, exename, local, props,
+        (cacheDir == NULL && traceFile == NULL && !g_isReadaheadEnabled ?
+        NULL : &handle));
+    // The handle is no longer valid once the root VFS is unmounted.
+    int isRemounted = 0;
+
+    if (handle != NULL && traceFile != NULL) {
+        Tcl_Obj *objv[] = {
+            handle,
+            Tcl_NewStringObj("getmetadata", -1),
+            Tcl_NewStringObj("cookit.trace", -1),
+            Tcl_NewObj()
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]), objv);
+        Tcl_IncrRefCount(cmd);
+        if (Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL) != TCL_OK ||
+            strcmp(Tcl_GetStringResult(interp), "") == 0 ||
+            strcmp(Tcl_GetStringResult(interp),
+            Tcl_GetString(traceFile)) != 0)
+        {
+            DBG("Cookit_Startup: COOKIT_TRACE is ignored");
+            Tcl_DecrRefCount(traceFile);
+            traceFile = NULL;
+        }
+        Tcl_DecrRefCount(cmd);
+        Tcl_ResetResult(interp);
+    } else if (traceFile != NULL) {
+        Tcl_DecrRefCount(traceFile);
+        traceFile = NULL;
+    }
+
+    // The cache is not used while files are traced, since the trace
+    // is recorded for the executable being wrapped.
+    if (handle != NULL && traceFile == NULL && cacheDir != NULL) {
+        Tcl_Obj *objv[] = {
+            Tcl_NewStringObj("::apply", -1),
+            Tcl_NewStringObj(cache_lambda, -1),
+            cacheDir,
+            exename,
+            handle
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]), objv);
+        Tcl_IncrRefCount(cmd);
+        Tcl_Obj *action = NULL;
+        if (Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL) == TCL_OK &&
+            Tcl_ListObjIndex(NULL, Tcl_GetObjResult(interp), 0,
+            &action) == TCL_OK && action != NULL)
+        {
+            Tcl_ListObjIndex(NULL, Tcl_GetObjResult(interp), 1, &cacheFile);
+            Tcl_IncrRefCount(cacheFile);
+            action = Tcl_DuplicateObj(action);
+        } else {
+            action = NULL;
+        }
+        Tcl_DecrRefCount(cmd);
+        Tcl_ResetResult(interp);
+
+        // If the cache file already contains the uncompressed copy of
+        // the root VFS, then mount the copy instead of the executable. It
+        // has the same content, but doesn't require decompression of pages.
+        if (action != NULL && strcmp(Tcl_GetString(action), "mount") == 0) {
+            DBG("Cookit_Startup: mount root vfs from cache [%s]",
+                Tcl_GetString(cacheFile));
+            Tcl_Obj *unmount[] = {
+                Tcl_NewStringObj("::cookfs::Unmount", -1),
+                local
+            };
+            cmd = Tcl_NewListObj(2, unmount);
+            Tcl_IncrRefCount(cmd);
+            if (Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL) == TCL_OK) {
+                isRemounted = 1;
+                if (mount_root(interp, cacheFile, local, props, NULL)) {
+                    Tcl_SetVar2Ex(interp, "::cookit::cache", NULL, cacheFile,
+                        TCL_GLOBAL_ONLY);
+                } else {
+                    isVFSAvailable = mount_root(interp, exename, local, props,
+                        NULL);
+                }
+            }
+            Tcl_DecrRefCount(cmd);
+            Tcl_ResetResult(interp);
+            Tcl_DecrRefCount(cacheFile);
+            cacheFile = NULL;
+        }
+
+        // Otherwise, cacheFile remains set only if this process is started
+        // in the background to create the cache file.
+        if (action != NULL) {
+            Tcl_DecrRefCount(action);
+        }
+
+    }
+
+    // ::cookit::relayout stores the range of the archive with pages of
+    // startup files in the cookit.startup metadata. Ask the kernel to read
+    // this range ahead, so that the following reads of these pages by
+    // Tcl_Init and the preload threads do not wait for the disk.
+    if (handle != NULL && g_isReadaheadEnabled && !isRemounted) {
+        Tcl_Obj *objv[] = {
+            handle,
+            Tcl_NewStringObj("getmetadata", -1),
+            Tcl_NewStringObj("cookit.startup", -1),
+            Tcl_NewObj()
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]), objv);
+        Tcl_IncrRefCount(cmd);
+        Tcl_Obj *range = NULL;
+        Tcl_Obj *offsetObj, *lengthObj;
+        Tcl_WideInt offset, length;
+        if (Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL) == TCL_OK &&
+            (range = Tcl_GetObjResult(interp)) != NULL &&
+            Tcl_ListObjIndex(NULL, range, 0, &offsetObj) == TCL_OK &&
+            Tcl_ListObjIndex(NULL, range, 1, &lengthObj) == TCL_OK &&
+            offsetObj != NULL && lengthObj != NULL &&
+            Tcl_GetWideIntFromObj(NULL, offsetObj, &offset) == TCL_OK &&
+            Tcl_GetWideIntFromObj(NULL, lengthObj, &length) == TCL_OK &&
+            Cookit_ReadaheadExecutable(Tcl_FSGetNativePath(exename), offset,
+            length) == TCL_OK)
+        {
+            DBG("Cookit_Startup: readahead offset: %" TCL_LL_MODIFIER "d"
+                " length: %" TCL_LL_MODIFIER "d", offset, length);
+            Tcl_SetVar2Ex(interp, "::cookit::readahead", NULL,
+                Tcl_DuplicateObj(range), TCL_GLOBAL_ONLY);
+        }
+        Tcl_DecrRefCount(cmd);
+        Tcl_ResetResult(interp);
+    }
+
+    if (handle != NULL) {
+        Tcl_DecrRefCount(handle);
+    }
+    if (cacheDir != NULL) {
+        Tcl_DecrRefCount(cacheDir);
+    }
+
     DBG("Cookit_Startup: vfs available: %d", isVFSAvailable);
+    Cookit_ProfileMark("mount");
 
     Cookfs_VfsPropsFree(props);
 
@@ -320,10 +619,100 @@ static int Cookit_Startup(Tcl_Interp *interp) {
         goto error;
     }
 
+    if (isVFSAvailable && traceFile != NULL) {
+        DBG("Cookit_Startup: trace files to [%s]",
+            Tcl_GetString(traceFile));
+        Tcl_Obj *objv[] = {
+            Tcl_NewStringObj("::apply", -1),
+            Tcl_NewStringObj(trace_lambda, -1),
+            traceFile,
+            Tcl_NewStringObj(VFS_MOUNT, -1)
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]),
+            objv);
+        Tcl_IncrRefCount(cmd);
+        int result = Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL);
+        Tcl_DecrRefCount(cmd);
+        Tcl_DecrRefCount(traceFile);
+        if (result != TCL_OK) {
+            goto error;
+        }
+    } else if (traceFile != NULL) {
+        Tcl_DecrRefCount(traceFile);
+    }
+
+    Cookit_ProfileMark("environment");
+
+#ifdef TCL_THREADS
+    // Start background threads that read files used at startup to
+    // decompress their pages into the shared page cache while Tcl_Init
+    // and the main script are running. This can be disabled by setting
+    // the COOKIT_PRELOAD environment variable to "0".
+    if (isVFSAvailable) {
+        const char *preloadEnv = Tcl_GetVar2(interp, "env", "COOKIT_PRELOAD",
+            TCL_GLOBAL_ONLY);
+        if (preloadEnv == NULL || strcmp(preloadEnv, "0") != 0) {
+            DBG("Cookit_Startup: start preload threads");
+            Cookit_PreloadStart(VFS_MOUNT);
+        }
+    }
+#endif /* TCL_THREADS */
+    Cookit_ProfileMark("preload");
+
     DBG("Cookit_Startup: initialize interp...");
     if (Tcl_Init(interp) != TCL_OK) {
         goto error;
     }
+    Cookit_ProfileMark("tcl_init");
+
+    if (isVFSAvailable) {
+        // Load the package index for the root VFS if the kit has it. It is
+        // created by ::cookit::wrap and registers all packages from the root
+        // VFS at once. Thus, the first [package require] will not glob and
+        // source every pkgIndex.tcl file in the VFS. If this file is broken,
+        // ignore it and let Tcl find packages in the usual way.
+        Tcl_Obj *pkgIndex = Tcl_NewStringObj(VFS_MOUNT "pkgindex.tcl", -1);
+        Tcl_IncrRefCount(pkgIndex);
+        if (Tcl_FSAccess(pkgIndex, F_OK) == 0) {
+            DBG("Cookit_Startup: load package index");
+            if (Tcl_FSEvalFileEx(interp, pkgIndex, "utf-8") != TCL_OK) {
+                DBG("Cookit_Startup: failed to load package index: %s",
+                    Tcl_GetStringResult(interp));
+                Tcl_ResetResult(interp);
+            }
+        }
+        Tcl_DecrRefCount(pkgIndex);
+    }
+    Cookit_ProfileMark("pkgindex");
+
+    // If this process is started by cache_lambda to create the cache file,
+    // then create it and exit. Errors are saved by the build command to
+    // the <cache file>.failed file.
+    if (isVFSAvailable && cacheFile != NULL) {
+        DBG("Cookit_Startup: create cache [%s]", Tcl_GetString(cacheFile));
+        Tcl_Obj *objv[] = {
+            Tcl_NewStringObj("::cookit::vfs", -1),
+            Tcl_NewStringObj("cache", -1),
+            Tcl_NewStringObj("build", -1),
+            cacheFile
+        };
+        Tcl_Obj *cmd = Tcl_NewListObj(sizeof(objv) / sizeof(objv[0]), objv);
+        Tcl_IncrRefCount(cmd);
+        if (Tcl_EvalEx(interp, "package require cookit", -1,
+            TCL_EVAL_GLOBAL) == TCL_OK)
+        {
+            Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL);
+        }
+        DBG("Cookit_Startup: create cache result: %s",
+            Tcl_GetStringResult(interp));
+        Tcl_DecrRefCount(cmd);
+        Tcl_DecrRefCount(cacheFile);
+        Tcl_Exit(0);
+    }
+    if (cacheFile != NULL) {
+        Tcl_DecrRefCount(cacheFile);
+    }
+    Cookit_ProfileMark("cache");
 
     // Check if we have a wrapped script in VFS
     Tcl_Obj *wrappedScript = Tcl_NewStringObj(VFS_MOUNT "main.tcl", -1);
@@ -436,6 +825,7 @@ skipNonInteractive:
 
     // Release argvObj object that was created above. We don't need it anymore.
     Tcl_DecrRefCount(argvObj);
+    Cookit_ProfileMark("main_script");
 
     DBG("Cookit_Startup: before exit...");
 #ifndef COOKIT_CONSOLE_ONLY
@@ -457,16 +847,26 @@ skipNonInteractive:
             if (Tcl_EvalEx(interp, "package require cookit::console", -1, TCL_EVAL_GLOBAL) != TCL_OK)
                 goto error;
         }
+        Cookit_ProfileMark("tk_init");
     }
 #endif /* COOKIT_CONSOLE_ONLY */
 
 done:
 
     DBG("Cookit_Startup: ok");
+    if (g_profileFile != NULL) {
+        // Errors are not fatal here. The profile is also available
+        // from ::cookit::startup_profile.
+        Cookit_ProfileWrite(NULL, g_profileFile);
+    }
     return TCL_OK;
 
 error:
     DBG("Cookit_Startup: RETURN ERROR");
+    if (g_profileFile != NULL) {
+        Cookit_ProfileMark("error");
+        Cookit_ProfileWrite(NULL, g_profileFile);
+    }
 #ifdef __WIN32__
     fprintf(stderr, "Fatal error: %s\n", Tcl_GetStringResult(interp));
     fflush(stderr);
@@ -519,6 +919,14 @@ int _tmain(int argc, TCHAR *argv[]) {
     g_isBootstrap = GetEnvironmentVariableA("COOKIT_BOOTSTRAP",
         NULL, 0) == 0 ? 0 : 1;
 
+    static char profileFile[MAX_PATH];
+    DWORD profileFileLen = GetEnvironmentVariableA("COOKIT_PROFILE",
+        profileFile, MAX_PATH);
+    if (profileFileLen > 0 && profileFileLen < MAX_PATH) {
+        g_profileFile = profileFile;
+        Cookit_ProfileStart();
+    }
+
 #ifndef COOKIT_CONSOLE_ONLY
     if (g_isConsoleMode) {
 #endif /* COOKIT_CONSOLE_ONLY */
@@ -544,6 +952,17 @@ int main(int argc, char **argv) {
 #endif /* COOKIT_CONSOLE_ONLY */
     g_isBootstrap = getenv("COOKIT_BOOTSTRAP") == NULL ? 0 : 1;
 
+    const char *readaheadEnv = getenv("COOKIT_READAHEAD");
+    g_isReadaheadEnabled = (readaheadEnv != NULL &&
+        strcmp(readaheadEnv, "1") == 0) ? 1 : 0;
+
+    g_profileFile = getenv("COOKIT_PROFILE");
+    if (g_profileFile != NULL && *g_profileFile != '\0') {
+        Cookit_ProfileStart();
+    } else {
+        g_profileFile = NULL;
+    }
+
     Tcl_Main(argc, argv, Cookit_Startup);
     return TCL_OK;
 }
@@ -19,7 +19,10 @@ proc ::cookit::builtin::wrap { args } {
 
     set known_options [list {*}{
         --paths --path --to --as
-        --output --stubfile --compression
+        --output --stubfile --compression --runtime-compression
+        --pkgindex --relayout --relayouttimeout
+        --threads --update --textpagesize
+        --pagesize --smallfilesize --smallfilebuffer
         --icon --company --copyright --fileversion --productname
         --productversion --filedescription --originalfilename
     }]
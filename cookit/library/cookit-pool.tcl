@@ -0,0 +1,115 @@
+# cookit - pool of pre-initialized worker threads
+#
+# Copyright (C) 2024 Konstantin Kushnir <chpock@gmail.com>
+#
+# See the file "license.terms" for information on usage and redistribution of
+# this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+package require cookit
+package require Thread
+
+namespace eval ::cookit::pool {
+
+    namespace export create post wait release
+    namespace ensemble create
+
+}
+
+# Creates a pool of worker threads and returns its identifier.
+#
+# All workers are started before this command returns. Each worker has
+# already run Tcl_Init, loaded the package index of the root VFS and
+# required the specified packages. Thus, jobs posted to the pool do not
+# pay the initialization cost.
+#
+# Options:
+#   -workers <count>  - the number of worker threads, the default is 4
+#   -packages <list>  - the list of packages to load in each worker. Each
+#                       element is a package name or a list of the package
+#                       name and the required version
+#   -initcmd <script> - the script to run in each worker after the packages
+#                       are loaded
+proc ::cookit::pool::create { args } {
+
+    set workers  4
+    set packages [list]
+    set initcmd  ""
+
+    for { set i 0 } { $i < [llength $args] } { incr i } {
+
+        set arg [lindex $args $i]
+        if { [incr i] == [llength $args] } {
+            return -code error "missing value for argument '$arg'"
+        }
+        set val [lindex $args $i]
+
+        switch -exact -- $arg {
+            -workers {
+                if { ![string is integer -strict $val] || $val < 1 } {
+                    return -code error "the number of workers must be\
+                        a positive integer, but got '$val'"
+                }
+                set workers $val
+            }
+            -packages { set packages $val }
+            -initcmd  { set initcmd  $val }
+            default {
+                return -code error "unknown argument: '$arg'"
+            }
+        }
+
+    }
+
+    # The package index of the root VFS is sourced only in the main
+    # interpreter by Cookit_Startup. Source it here as well, so that
+    # the workers don't scan all pkgIndex.tcl files in the root VFS.
+    set script [list apply {{ index } {
+        if { [file exists $index] } {
+            uplevel #0 [list source -encoding utf-8 $index]
+        }
+    }} [file join $::cookit::root pkgindex.tcl]]
+
+    foreach package $packages {
+        append script \n [list package require {*}$package]
+    }
+
+    append script \n $initcmd
+
+    # All workers are created at once and never exit while the pool exists.
+    # Jobs are stored in the common queue of the pool, and each worker takes
+    # the next job as soon as it becomes idle.
+    return [::tpool::create -minworkers $workers -maxworkers $workers \
+        -idletime 0 -initcmd $script]
+
+}
+
+# Posts the script to the pool and returns the job identifier.
+proc ::cookit::pool::post { pool script } {
+    return [::tpool::post $pool $script]
+}
+
+# Waits for all specified jobs to complete and returns the list of their
+# results in the same order. If any job failed, its error is raised.
+proc ::cookit::pool::wait { pool jobs } {
+
+    set pending $jobs
+    while { [llength $pending] } {
+        ::tpool::wait $pool $pending pending
+    }
+
+    set result [list]
+    foreach job $jobs {
+        lappend result [::tpool::get $pool $job]
+    }
+
+    return $result
+
+}
+
+# Releases the pool. Worker threads exit after completing their current jobs.
+proc ::cookit::pool::release { pool } {
+    ::tpool::release $pool
+    return
+}
+
+package provide cookit::pool 1.0.0
@@ -12,6 +12,11 @@ proc ::cookit::stats { args } {
     if { [llength $args] } {
         set root    [lindex $args 0]
         ::cookfs::Mount -readonly $root $root
+    } elseif { [info exists ::cookit::cache] } {
+        # The root VFS is mounted from the persistent cache. Show statistics
+        # for the executable itself.
+        set root    [info nameofexecutable]
+        ::cookfs::Mount -readonly $root $root
     } {
         set root    $::cookit::root
     }
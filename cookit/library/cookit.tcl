@@ -13,6 +13,30 @@ namespace eval ::cookit {
     # variable is available for child/threaded interpreters.
     variable root "//cookit:/"
 
+    # Temporary .tar files for mounted .tar.gz archives. The key is
+    # the mount point. See archive_mount and archive_unmount.
+    variable archive_temp [dict create]
+
+    # Signatures of already compressed file formats. Each element is a list of
+    # the offset and the bytes at that offset.
+    variable compressed_signatures {
+        {0 "\x89PNG\r\n\x1a\n"}
+        {0 "\xff\xd8\xff"}
+        {0 "GIF87a"} {0 "GIF89a"}
+        {8 "WEBP"}
+        {4 "ftyp"}
+        {0 "OggS"} {0 "fLaC"} {0 "ID3"}
+        {0 "PK\x03\x04"}
+        {0 "\x1f\x8b"}
+        {0 "\xfd\x37zXZ\x00"}
+        {0 "BZh"}
+        {0 "7z\xbc\xaf\x27\x1c"}
+        {0 "\x28\xb5\x2f\xfd"}
+        {0 "\x04\x22\x4d\x18"}
+        {0 "Rar!\x1a\x07"}
+        {0 "wOF2"}
+    }
+
 }
 
 #if { [::tcl::pkgconfig get threaded] } {
@@ -35,11 +59,284 @@ namespace eval ::cookit {
 #}
 
 proc ::cookit::recursive_glob { dir pattern } {
-    set files [lsort [glob -nocomplain -type f -directory $dir $pattern]]
-    foreach dir [lsort [glob -nocomplain -type d -directory $dir *]] {
-        lappend files {*}[recursive_glob $dir $pattern]
+    return [walk $dir -pattern $pattern]
+}
+
+# ::cookit::walk is implemented in cookit.c. This version is used only
+# when this file is sourced without the cookit library.
+if { ![llength [info commands ::cookit::walk]] } {
+    proc ::cookit::walk { dir args } {
+        set pattern "*"
+        set is_stat 0
+        for { set i 0 } { $i < [llength $args] } { incr i } {
+            switch -exact -- [lindex $args $i] {
+                -pattern { set pattern [lindex $args [incr i]] }
+                -stat    { set is_stat 1 }
+                default {
+                    return -code error "bad option \"[lindex $args $i]\":\
+                        must be -pattern or -stat"
+                }
+            }
+        }
+        set result [list]
+        foreach file [lsort [glob -nocomplain -type f -directory $dir $pattern]] {
+            lappend result $file
+            if { $is_stat } {
+                file stat $file stat
+                lappend result [list file $stat(size) $stat(mtime)]
+            }
+        }
+        foreach dir [lsort [glob -nocomplain -type d -directory $dir *]] {
+            if { $is_stat } {
+                file stat $dir stat
+                lappend result $dir [list directory 0 $stat(mtime)]
+            }
+            lappend result {*}[walk $dir {*}$args]
+        }
+        return $result
+    }
+}
+
+namespace eval ::cookit::vfs {
+
+    namespace export cache layout
+    namespace ensemble create
+
+    namespace eval cache {
+        namespace export build
+        namespace ensemble create
+    }
+
+}
+
+# Returns the page layout of the mounted VFS. By default, this is the root
+# VFS. Cookfs doesn't provide runtime counters of its page cache, so this
+# is the static information which is useful to choose the page cache size.
+# The result is a dictionary with the following keys:
+#   pagecachesize - the page cache size in pages set by the COOKIT_PAGECACHE
+#                   environment variable, or "default"
+#   pages         - the total number of pages
+#   codecs        - a dictionary where keys are compression methods and
+#                   values are dictionaries with the number of pages,
+#                   the total compressed and uncompressed size of these
+#                   pages, and the uncompressed size of the largest page
+proc ::cookit::vfs::layout { { mount "" } } {
+
+    set pagecachesize "default"
+    if { $mount eq "" } {
+        set mount $::cookit::root
+        if { [info exists ::cookit::pagecachesize] } {
+            set pagecachesize $::cookit::pagecachesize
+        }
+    }
+
+    set length [file attributes $mount -pages]
+
+    set codecs [dict create]
+    for { set i 0 } { $i < $length } { incr i } {
+        set page [file attributes $mount -pages $i]
+        set codec [dict get $page compression]
+        if { ![dict exists $codecs $codec] } {
+            dict set codecs $codec [dict create pages 0 compsize 0 \
+                uncompsize 0 largest 0]
+        }
+        dict with codecs $codec {
+            incr pages
+            incr compsize [dict get $page compsize]
+            incr uncompsize [dict get $page uncompsize]
+            if { [dict get $page uncompsize] > $largest } {
+                set largest [dict get $page uncompsize]
+            }
+        }
+    }
+
+    return [dict create pagecachesize $pagecachesize pages $length codecs $codecs]
+
+}
+
+# Creates the persistent cache file for the root VFS. This is an uncompressed
+# copy of the root VFS, which is mounted instead of the executable at startup
+# when the COOKIT_CACHE environment variable is set (see main.c). This
+# command is called by a background process started by Cookit_Startup when
+# the cache file doesn't exist yet.
+proc ::cookit::vfs::cache::build { file } {
+
+    variable ::cookit::root
+
+    # Only one process builds the cache. The lock file is removed at the end,
+    # but a lock file left by a killed process is ignored after 10 minutes.
+    set lock "$file.lock"
+    if { [file exists $lock] && [clock seconds] - [file mtime $lock] >= 600 } {
+        catch { file delete -force $lock }
+    }
+    if { [catch { open $lock {WRONLY CREAT EXCL} 0o600 } fd] } {
+        return -code error "the cache is being built by another process"
+    }
+    close $fd
+
+    # Build the cache in a temporary file and rename it at the end. Thus,
+    # concurrent processes will not see an incomplete cache file.
+    set temp "$file.[pid].tmp"
+
+    # make sure that we unmount $temp and remove the lock on any error
+    catch {
+
+        ::cookfs::Mount $temp $temp -compression none \
+            -pagesize [expr { 1024 * 1024 }] \
+            -smallfilesize [expr { 1024 * 512 }] \
+            -smallfilebuffer [expr { 1024 * 1024 * 64 }]
+
+        foreach path [glob -nocomplain -directory $root * .*] {
+            if { [file tail $path] in {. ..} } continue
+            file copy $path $temp
+        }
+
+        ::cookfs::Unmount $temp
+
+        # Remove cache files for previous builds of the same executable.
+        # They have the same prefix, which is based on the executable path.
+        set prefix [lindex [split [file tail $file] -] 0]
+        foreach old [glob -nocomplain -type f -directory [file dirname $file] $prefix-*.cfs] {
+            catch { file delete -force $old }
+        }
+
+        file rename -force $temp $file
+
+    } res opts
+
+    # Remember the failure, so the following runs will not try to build
+    # the cache again for this build of the executable.
+    if { [dict get $opts -code] == 1 } {
+        catch {
+            set fd [open "$file.failed" w]
+            puts $fd $res
+            close $fd
+        }
+    }
+
+    catch { ::cookfs::Unmount $temp }
+    catch { file delete -force $temp }
+    catch { file delete -force $lock }
+
+    return -options $opts $res
+
+}
+
+# Selects the compression method for the file content. The first 64 KB
+# of the content are checked for a signature of an already compressed
+# format and then compressed by the fastest zlib level. Returns "none"
+# for incompressible data, "zlib" if the data is only slightly compressible
+# and it is not worth spending time on lzma decompression at runtime,
+# and "lzma" otherwise.
+proc ::cookit::detect_compression { data } {
+
+    set sample [string range $data 0 65535]
+    if { ![string length $sample] } {
+        return "lzma"
+    }
+
+    variable compressed_signatures
+    foreach signature $compressed_signatures {
+        lassign $signature offset bytes
+        set last [expr { $offset + [string length $bytes] - 1 }]
+        if { [string range $sample $offset $last] eq $bytes } {
+            return "none"
+        }
+    }
+
+    # The result of compressing a few bytes is unreliable. Such files will
+    # be in the small file buffer and compressed together with other files.
+    if { [string length $sample] < 4096 } {
+        return "lzma"
+    }
+
+    set ratio [expr { double([string length [zlib deflate $sample 1]]) \
+        / [string length $sample] }]
+
+    if { $ratio >= 0.95 } {
+        return "none"
+    } elseif { $ratio >= 0.85 } {
+        return "zlib"
+    }
+    return "lzma"
+
+}
+
+# Prepares the file for adding to VFS. Returns a list of 4 elements:
+# the destination name, "file", the file name and the compression method
+# for the file. If the specified compression is "auto", then
+# it is selected by ::cookit::detect_compression.
+proc ::cookit::prepare_file { file name compression } {
+    if { $compression eq "auto" } {
+        set fh [open $file rb]
+        set compression [detect_compression [read $fh 65536]]
+        close $fh
+    }
+    return [list $name file $file $compression]
+}
+
+# Prepares files for adding to VFS by ::cookit::prepare_file. The argument
+# is a list of pairs: the file name and the destination name. Returns
+# a flat list of results from ::cookit::prepare_file in the same order as
+# the files. If the number of threads is greater than 1 and there are
+# enough files, then files are prepared in a pool of worker threads.
+# Pages are compressed later by cookfs in the current thread, so the pool
+# only speeds up the selection of compression with the "auto" method.
+proc ::cookit::prepare_files { files compression threads } {
+
+    # Only files with automatic compression require some work
+    if { $compression ne "auto" } {
+        set threads 1
     }
-    return $files
+
+    # Each file requires compressing at most 64 KB by the fastest zlib
+    # level, while each worker initializes its own interpreter and loads
+    # the cookit package. The pool pays off only for many files.
+    if { [llength $files] / 2 < 256 } {
+        set threads 1
+    }
+
+    if { $threads < 2 || ![::tcl::pkgconfig get threaded] } {
+        set result [list]
+        foreach { file name } $files {
+            lappend result {*}[prepare_file $file $name $compression]
+        }
+        return $result
+    }
+
+    package require cookit::pool
+
+    set pool [::cookit::pool create -workers $threads -packages cookit]
+
+    # make sure that we release the pool on any error
+    catch {
+
+        # Send files to workers in batches to reduce the overhead of
+        # passing jobs between threads. Each worker should get several
+        # batches to balance the load.
+        set batch [expr { max(1, [llength $files] / 2 / ($threads * 4)) }]
+        set jobs [list]
+        for { set i 0 } { $i < [llength $files] } { incr i [expr { $batch * 2 }] } {
+            set part [lrange $files $i [expr { $i + $batch * 2 - 1 }]]
+            lappend jobs [::cookit::pool post $pool \
+                [list ::cookit::prepare_files $part $compression 1]]
+        }
+
+        # Results are returned in the order of jobs, so the output doesn't
+        # depend on the order in which the workers complete them.
+        set result [list]
+        foreach part [::cookit::pool wait $pool $jobs] {
+            lappend result {*}$part
+        }
+
+        return $result
+
+    } res opts
+
+    catch { ::cookit::pool release $pool }
+
+    return -options $opts $res
+
 }
 
 proc ::cookit::addfiles { filename arg_files arg_names args } {
@@ -47,19 +344,48 @@ proc ::cookit::addfiles { filename arg_files arg_names args } {
     set files [list]
     set names [list]
 
-    foreach file $arg_files name $arg_names {
+    # -threads, -update and -textpagesize are our options, all other
+    # options are passed to ::cookfs::Mount
+    set update 0
+    if { [dict exists $args -update] } {
+        set update [dict get $args -update]
+        dict unset args -update
+    }
+    set threads 1
+    if { [dict exists $args -threads] } {
+        set threads [dict get $args -threads]
+        dict unset args -threads
+    }
+    set textpagesize 0
+    if { [dict exists $args -textpagesize] } {
+        set textpagesize [dict get $args -textpagesize]
+        dict unset args -textpagesize
+    }
+
+    # The type, size and modification time of each file. Files in
+    # directories are collected by ::cookit::walk that returns these
+    # values without an additional stat call for each file.
+    set stats [dict create]
 
-        lappend files $file
-        lappend names $name
+    foreach file $arg_files name $arg_names {
 
         if { ![file isdirectory $file] } {
+            file stat $file stat
+            lappend files $file
+            lappend names $name
+            dict set stats $file [list file $stat(size) $stat(mtime)]
             continue
         }
 
         set strip_path [llength [file split $file]]
-        foreach path [recursive_glob $file *] {
+        foreach { path attrs } [walk $file -stat] {
+
+            if { [lindex $attrs 0] ne "file" } {
+                continue
+            }
 
             lappend files $path
+            dict set stats $path $attrs
 
             set path [file split $path]
             set path [lrange $path $strip_path end]
@@ -71,31 +397,370 @@ proc ::cookit::addfiles { filename arg_files arg_names args } {
 
     }
 
-    set h [::cookfs::Mount $filename $filename {*}$args]
-    set params [list]
-    set dirs [list]
-    foreach file $files name $names {
-        set dir [file dirname $name]
-        if { $dir ne "." && [lsearch -exact $dirs $dir] == -1 } {
-            lappend dirs $dir
+    # The size, modification time and CRC32 of source files are stored
+    # in VFS metadata. They are used to find changed files when the VFS
+    # is updated. CRC32 requires reading the whole file, so it is only
+    # calculated in update mode for changed files. Files without CRC32 in
+    # the metadata are compared with their copies in the existing VFS.
+    set meta_old [dict create]
+    if { $update } {
+        set h [::cookfs::Mount -readonly $filename $filename]
+        set meta_old [$h getmetadata cookit.files [dict create]]
+    }
+    set meta [dict create]
+
+    set content [dict create]
+    set prepare [list]
+    set dirs [dict create]
+
+    # make sure that we unmount $filename on any error
+    catch {
+
+        foreach file $files name $names {
+            set dir [file dirname $name]
+            if { $dir ne "." } {
+                dict set dirs $dir 1
+            }
+            lassign [dict get $stats $file] -> stat(size) stat(mtime)
+            set crc_new ""
+            if { [dict exists $meta_old $name] } {
+                lassign [dict get $meta_old $name] size mtime crc
+                if { $size == $stat(size) && $mtime == $stat(mtime) } {
+                    dict set meta $name [dict get $meta_old $name]
+                    continue
+                }
+                if { $size == $stat(size) } {
+                    if { $crc eq "" } {
+                        set same [files_equal $file [file join $filename $name]]
+                    } else {
+                        set crc_new [file_crc32 $file]
+                        set same [expr { $crc eq $crc_new }]
+                    }
+                    if { $same } {
+                        dict set meta $name [list $stat(size) $stat(mtime) $crc]
+                        continue
+                    }
+                }
+            }
+            if { $update && $crc_new eq "" } {
+                set crc_new [file_crc32 $file]
+            }
+            dict set meta $name [list $stat(size) $stat(mtime) $crc_new]
+            dict lappend content $stat(size) $file $name
+            lappend prepare $file $name
+        }
+
+    } res opts
+
+    if { $update } {
+        catch { ::cookfs::Unmount $filename }
+    }
+
+    if { [dict get $opts -code] } {
+        return -options $opts $res
+    }
+
+    # Find files with the same content. They are written with their own
+    # pages, so cookfs stores these pages only once, and all copies refer
+    # to the same pages. Only files of the same size are compared, and
+    # CRC32 is calculated only for them to avoid comparing each pair.
+    set duplicates [dict create]
+    dict for { size list } $content {
+        if { [llength $list] < 4 } continue
+        set groups [dict create]
+        foreach { file name } $list {
+            set crc [lindex [dict get $meta $name] 2]
+            if { $crc eq "" } {
+                set crc [file_crc32 $file]
+            }
+            dict lappend groups $crc $file $name
         }
-        if { ![file isdirectory $file] } {
-            # <destination name> "file" <filename> <size> (the size will
-            # be calculated automatically)
-            lappend params $name file $file ""
+        dict for { crc group } $groups {
+            if { [llength $group] < 4 } continue
+            set group [lassign $group first_file first_name]
+            foreach { file name } $group {
+                if { [files_equal $first_file $file] } {
+                    dict set duplicates $first_name 1
+                    dict set duplicates $name 1
+                }
+            }
         }
     }
-    # directories to create
-    set dirs2 [list]
-    foreach dir $dirs {
-        set dir [file join $filename $dir]
-        if { ![file isdirectory $dir] } {
-            lappend dirs2 $dir
+
+    # The "auto" compression is our option. The compression method for each
+    # file will be selected by ::cookit::prepare_file.
+    set compression ""
+    if { [dict exists $args -compression] } {
+        set compression [dict get $args -compression]
+        if { $compression eq "auto" } {
+            dict unset args -compression
+        }
+    }
+
+    # Files are written in separate sessions, one for each compression
+    # method and file class. Each session flushes the small file buffer
+    # when the VFS is unmounted. Thus, small files of the same class
+    # share the same pages, and these pages don't contain unrelated data.
+    set sessions [dict create]
+    foreach { name type value codec } \
+        [prepare_files $prepare $compression $threads] \
+    {
+        # <destination name> <type> <filename or content> <size> (the size
+        # will be calculated automatically)
+        if { [dict exists $duplicates $name] } {
+            set class "duplicate"
+        } else {
+            set class [file_class $name]
+        }
+        dict lappend sessions [list $codec $class] $name $type $value ""
+    }
+    if { ![dict size $sessions] } {
+        dict set sessions [list [expr { $compression eq "auto" ? "" : $compression }] ""] [list]
+    }
+
+    set first 1
+    set count [dict size $sessions]
+    dict for { session params } $sessions {
+
+        set codec [lindex $session 0]
+
+        set opts $args
+        if { $codec ne "" } {
+            dict set opts -compression $codec
+        }
+        # Incompressible files are stored in their own pages. There is
+        # no reason to collect them in the small file buffer.
+        if { $codec eq "none" && $compression eq "auto" } {
+            dict set opts -smallfilesize 0
+        }
+        # Files with the same content should have their own pages to be
+        # deduplicated.
+        if { [lindex $session 1] eq "duplicate" } {
+            dict set opts -smallfilesize 0
+        }
+        # Scripts and message catalogs are loaded one package at a time.
+        # Smaller pages for them mean that loading a package doesn't
+        # decompress scripts of other packages.
+        if { $textpagesize > 0 && [lindex $session 1] in {script msgcat} } {
+            dict set opts -pagesize $textpagesize
+        }
+
+        set h [::cookfs::Mount $filename $filename {*}$opts]
+
+        if { $first } {
+
+            # Delete files that were added by the previous wrap, but are not
+            # in the list of files now.
+            foreach name [dict keys $meta_old] {
+                if { ![dict exists $meta $name] } {
+                    file delete -force [file join $filename $name]
+                }
+            }
+
+            # directories to create
+            set dirs2 [list]
+            foreach dir [dict keys $dirs] {
+                set dir [file join $filename $dir]
+                if { ![file isdirectory $dir] } {
+                    lappend dirs2 $dir
+                }
+            }
+            file mkdir {*}$dirs2
+
+            set first 0
+
+        }
+
+        if { [llength $params] } {
+            $h writeFiles {*}$params
+        }
+
+        # Metadata is saved only when all files are written
+        if { ![incr count -1] } {
+            $h setmetadata cookit.files $meta
+        }
+
+        ::cookfs::Unmount $filename
+
+    }
+}
+
+# Returns the class of the file by its name. Files of the same class are
+# stored in the same pages.
+proc ::cookit::file_class { name } {
+    switch -exact -- [string tolower [file extension $name]] {
+        .tcl - .tm - .test  { return "script"   }
+        .enc                { return "encoding" }
+        .msg                { return "msgcat"   }
+        .so - .dll - .dylib - .a - .lib - .exe - .o - .obj - .bin {
+            return "binary"
+        }
+    }
+    return "other"
+}
+
+# Returns true if both files have the same content
+proc ::cookit::files_equal { file1 file2 } {
+    if { [file size $file1] != [file size $file2] } {
+        return 0
+    }
+    set fh1 [open $file1 rb]
+    set fh2 [open $file2 rb]
+    set result 1
+    while { ![eof $fh1] } {
+        if { [read $fh1 1048576] ne [read $fh2 1048576] } {
+            set result 0
+            break
+        }
+    }
+    close $fh1
+    close $fh2
+    return $result
+}
+
+# Returns CRC32 of the file content
+proc ::cookit::file_crc32 { file } {
+    set crc 0
+    set fh [open $file rb]
+    while { ![eof $fh] } {
+        set crc [zlib crc32 [read $fh 1048576] $crc]
+    }
+    close $fh
+    return $crc
+}
+
+# Stores the checksum of the cookfs archive to its cookit.id metadata. It
+# identifies the content of the root VFS and is used as a key for
+# the persistent cache (see cache_lambda in main.c). Thus, the executable
+# doesn't need to be read at startup to check whether the cache is valid.
+proc ::cookit::buildid_set { file } {
+    set crc 0
+    set adler 1
+    set fh [open $file rb]
+    while { ![eof $fh] } {
+        set data [read $fh 1048576]
+        set crc [zlib crc32 $data $crc]
+        set adler [zlib adler32 $data $adler]
+    }
+    set size [tell $fh]
+    close $fh
+    set file [file normalize $file]
+    set h [::cookfs::Mount $file $file]
+    $h setmetadata cookit.id [format %08x%08x%x $crc $adler $size]
+    ::cookfs::Unmount $file
+}
+
+# Returns 1 if the executable can be updated by ::cookit::wrap with
+# the -update option, i.e. it was created by ::cookit::wrap, it contains
+# metadata about wrapped files, and it was wrapped with the same options
+# as specified now. The options are the stub, Windows resources and
+# compression and page options, which affect the content of
+# the executable other than the changed files.
+proc ::cookit::is_updatable { exe options } {
+    if { ![file isfile $exe] } {
+        return 0
+    }
+    set exe [file normalize $exe]
+    if { [catch { ::cookfs::Mount -readonly $exe $exe } h] } {
+        return 0
+    }
+    set result [expr { [$h getmetadata cookit.files ""] ne ""
+        && [$h getmetadata cookit.options ""] eq $options }]
+    ::cookfs::Unmount $exe
+    return $result
+}
+
+# If the path has the format <archive>!<path>, where the archive is
+# a .tar, .tar.gz, .tgz or .zip file, returns a list of the archive file
+# and the path inside the archive. Otherwise, returns an empty list.
+proc ::cookit::archive_split { path } {
+    if { ![regexp -nocase {^(.+\.(?:tar|tar\.gz|tgz|zip))!(.*)$} $path -> archive inner] } {
+        return [list]
+    }
+    if { ![file isfile $archive] } {
+        return [list]
+    }
+    return [list $archive [string trimleft $inner /]]
+}
+
+# Returns the last component of the path. For the root of an archive
+# specified as <archive>!, returns the archive file name.
+proc ::cookit::path_tail { path } {
+    set archive [archive_split $path]
+    if { [llength $archive] && [lindex $archive 1] eq "" } {
+        return [file tail [lindex $archive 0]]
+    }
+    return [file tail $path]
+}
+
+# Mounts the archive from the path in the format <archive>!<path> over
+# the archive file and returns the corresponding path in the mounted VFS.
+# The archive mount point is added to the list in the mounts variable if
+# the archive was not mounted before. The content of .tar and .zip archives
+# is read directly from the archive file. The .tar.gz archives are
+# decompressed once in a single pass to a temporary .tar file, which is
+# mounted instead. Mounted archives should be unmounted by archive_unmount.
+proc ::cookit::archive_mount { path mountsVar } {
+
+    upvar 1 $mountsVar mounts
+
+    variable archive_temp
+
+    package require vfs
+
+    lassign [archive_split $path] archive inner
+    set archive [file normalize $archive]
+
+    if { $archive ni [::vfs::filesystem info] } {
+        switch -glob -- [string tolower $archive] {
+            *.zip {
+                package require vfs::zip
+                ::vfs::zip::Mount $archive $archive
+            }
+            *.tar {
+                package require vfs::tar
+                ::vfs::tar::Mount $archive $archive
+            }
+            default {
+                package require vfs::tar
+                set out [file tempfile temp cookit.tar]
+                fconfigure $out -translation binary
+                # make sure that we remove the temporary file on any error
+                if { [catch {
+                    set in [open $archive rb]
+                    zlib push gunzip $in
+                    fcopy $in $out
+                    close $in
+                    close $out
+                    ::vfs::tar::Mount $temp $archive
+                } err opts] } {
+                    catch { close $in }
+                    catch { close $out }
+                    file delete -force $temp
+                    return -options $opts $err
+                }
+                dict set archive_temp $archive $temp
+            }
         }
+        lappend mounts $archive
+    }
+
+    if { $inner eq "" } {
+        return $archive
+    }
+    return [file join $archive $inner]
+
+}
+
+# Unmounts the archive mounted by archive_mount and removes its temporary
+# file, if any.
+proc ::cookit::archive_unmount { archive } {
+    variable archive_temp
+    catch { ::vfs::unmount $archive }
+    if { [dict exists $archive_temp $archive] } {
+        catch { file delete -force [dict get $archive_temp $archive] }
+        dict unset archive_temp $archive
     }
-    file mkdir {*}$dirs2
-    $h writeFiles {*}$params
-    ::cookfs::Unmount $filename
 }
 
 proc ::cookit::is_pe_file { exe } {
@@ -422,10 +1087,20 @@ proc ::cookit::windows_resources_parse { exe } {
 
 }
 
-proc ::cookit::copy_tcl_runtime { manifest dest } {
+# Copies the Tcl runtime files listed in the manifest to the VFS of
+# the executable. If the compression is not specified, then the encoding
+# files are compressed by lzma:5 and other files by the default method.
+proc ::cookit::copy_tcl_runtime { manifest dest { compression "" } } {
 
     set root [file dirname $manifest]
 
+    set encoding_compression lzma:5
+    set opts [list]
+    if { $compression ne "" } {
+        set encoding_compression $compression
+        lappend opts -compression $compression
+    }
+
     set fh [open $manifest r]
 
     # The 1st pass.
@@ -436,7 +1111,7 @@ proc ::cookit::copy_tcl_runtime { manifest dest } {
     # for lzma compression, 5 is the optimal compression level for these files.
     # Higher compression levels do not reduce the size of the compressed data.
     ::cookfs::Mount $dest $dest \
-        -compression lzma:5 \
+        -compression $encoding_compression \
         -pagesize [expr { 1024 * 1024 * 5 }] \
         -smallfilesize [expr { 1024 * 1024 * 5 }] \
         -smallfilebuffer [expr { 1024 * 1024 * 5 }]
@@ -454,13 +1129,14 @@ proc ::cookit::copy_tcl_runtime { manifest dest } {
     seek $fh 0
 
     # The 2nd pass.
-    # Copy all other files. Use the default compression.
+    # Copy all other files. Use the default compression if no compression
+    # is specified.
     # -pagesize: Use 1MB as the page size.
     # -smallfilesize: If the file is larger than 512 KB, consider it a non-text
     #                 file and place it on a separate page.
     # -smallfilebuffer: Use a large smallbuffer (5MB) to efficiently sort all
     #                   runtime files before storing them to pages.
-    ::cookfs::Mount $dest $dest \
+    ::cookfs::Mount $dest $dest {*}$opts \
         -pagesize [expr { 1024 * 1024 }] \
         -smallfilesize [expr { 1024 * 512 }] \
         -smallfilebuffer [expr { 1024 * 1024 * 5 }]
@@ -477,23 +1153,444 @@ proc ::cookit::copy_tcl_runtime { manifest dest } {
     ::cookfs::Unmount $dest
     close $fh
 
+    buildid_set $dest
+
 }
 
-proc ::cookit::makestub { exe } {
+# Returns 1 if the root VFS contains only the Tcl runtime files listed
+# in manifest.txt. This is true for Cookit itself, but not for executables
+# created by ::cookit::wrap.
+proc ::cookit::is_runtime_only { } {
 
     variable root
 
+    set manifest [file join $root manifest.txt]
+    if { ![file isfile $manifest] } {
+        return 0
+    }
+
+    set fh [open $manifest r]
+    fconfigure $fh -encoding utf-8
+    set expected [list manifest.txt]
+    foreach file [split [read $fh] \n] {
+        if { $file ne "" } {
+            lappend expected $file
+        }
+    }
+    close $fh
+
+    set actual [list]
+    set strip [llength [file split $root]]
+    foreach path [recursive_glob $root *] {
+        lappend actual [file join {*}[lrange [file split $path] $strip end]]
+    }
+
+    return [expr { [lsort -unique $expected] eq [lsort -unique $actual] }]
+
+}
+
+proc ::cookit::makestub { exe { compression "" } } {
+
+    variable root
+
+    # If the current executable contains only the Tcl runtime, then it is
+    # exactly what copy_tcl_runtime would create with the default
+    # compression. Copy it as is instead of decompressing and compressing
+    # the runtime again.
+    if { $compression eq "" && [is_runtime_only] } {
+        file copy -force [info nameofexecutable] $exe
+        set_exec_perms $exe
+        return $exe
+    }
+
+    # If the root VFS is mounted from the persistent cache, then it has
+    # no stub. Get the stub from the executable itself.
+    if { [info exists ::cookit::cache] } {
+        set stub [info nameofexecutable]
+        ::cookfs::Mount -readonly $stub $stub
+    } else {
+        set stub $::cookit::root
+    }
+
     set fh [open $exe wb]
-    file attributes $::cookit::root -parts [list head $fh]
+    file attributes $stub -parts [list head $fh]
     close $fh
 
-    copy_tcl_runtime [file join $root manifest.txt] $exe
+    if { [info exists ::cookit::cache] } {
+        ::cookfs::Unmount $stub
+    }
+
+    copy_tcl_runtime [file join $root manifest.txt] $exe $compression
     set_exec_perms $exe
 
     return $exe
 
 }
 
+# Generates a package index for all packages in the VFS of the executable
+# and saves it as pkgindex.tcl in the VFS root. At startup, this file is
+# sourced after Tcl_Init (see main.c) and packages from the root VFS become
+# known without globbing and sourcing each pkgIndex.tcl file and each
+# Tcl module directory. Returns 1 if the index was created and 0 if
+# the executable is built for another Tcl version and its package indexes
+# cannot be evaluated here.
+proc ::cookit::pkgindex_generate { exe } {
+
+    variable root
+
+    set exe [file normalize $exe]
+
+    ::cookfs::Mount $exe $exe
+
+    # make sure that we unmount $exe on any error
+    catch {
+
+    set tcl_dir [file join $exe lib tcl[info tclversion]]
+    if { ![file isdirectory $tcl_dir] } {
+        return 0
+    }
+
+    set index [list]
+
+    # These are the runtime paths from $::auto_path in the root VFS. They
+    # are processed the same way as tclPkgUnknown does: pkgIndex.tcl
+    # in the directory itself and in its direct subdirectories.
+    set interp [interp create]
+    interp eval $interp {
+        rename ::package ::cookit_package
+        proc ::package { cmd args } {
+            if { $cmd eq "ifneeded" && [llength $args] == 3 } {
+                lappend ::cookit_index {*}$args
+                return
+            }
+            tailcall ::cookit_package $cmd {*}$args
+        }
+    }
+    foreach dir [list [file join $exe lib] $tcl_dir] {
+        set files [lsort [glob -nocomplain -type f -directory $dir -join * pkgIndex.tcl]]
+        if { [file isfile [file join $dir pkgIndex.tcl]] } {
+            lappend files [file join $dir pkgIndex.tcl]
+        }
+        foreach file $files {
+            interp eval $interp [list set ::cookit_index [list]]
+            interp eval $interp [list set dir [file dirname $file]]
+            # Broken indexes are ignored the same way tclPkgUnknown does.
+            if { [catch { interp eval $interp [list source -encoding utf-8 $file] }] } {
+                continue
+            }
+            lappend index {*}[interp eval $interp [list set ::cookit_index]]
+        }
+    }
+    interp delete $interp
+
+    # Tcl modules from the default module paths. See ::tcl::tm::Defaults.
+    lassign [split [info tclversion] .] major minor
+    set tm_roots [list [file join $exe lib tcl$major site-tcl]]
+    for { set i 0 } { $i <= $minor } { incr i } {
+        lappend tm_roots [file join $exe lib tcl$major "${major}.$i"]
+    }
+    foreach tm_root $tm_roots {
+        set strip [llength [file split $tm_root]]
+        foreach file [recursive_glob $tm_root *.tm] {
+            set tail [file rootname [file tail $file]]
+            if { ![regexp {^(.+)-([[:digit:]].*)$} $tail -> name version] } continue
+            if { [catch { package vcompare $version 0 }] } continue
+            set name [join [concat [lrange [file split [file dirname $file]] $strip end] [list $name]] ::]
+            lappend index $name $version \
+                "[list package provide $name $version];[list source -encoding utf-8 $file]"
+        }
+    }
+
+    # Paths in the scripts point to the currently mounted executable.
+    # Make them point to the root VFS.
+    set map [list "$exe/" $root]
+
+    set fh [open [file join $exe pkgindex.tcl] w]
+    fconfigure $fh -encoding utf-8 -translation lf
+    puts $fh "# Package index for the root VFS, generated by ::cookit::wrap"
+    foreach { name version script } $index {
+        puts $fh [list package ifneeded $name $version [string map $map $script]]
+    }
+    # All packages from the root VFS are already registered. The package
+    # unknown handler must search packages only outside of the root VFS.
+    # Paths from the root VFS are temporarily removed from $::auto_path
+    # and the list of Tcl module paths.
+    set handler {{ root original name args } {
+        catch { ::tcl::tm::path list }
+        set saved [list]
+        foreach var { ::auto_path ::tcl::tm::paths } {
+            if { ![info exists $var] } continue
+            set orig [set $var]
+            set ext [list]
+            foreach path $orig {
+                if { ![string match "${root}*" $path] } {
+                    lappend ext $path
+                }
+            }
+            lappend saved $var $orig $ext
+            set $var $ext
+        }
+        try {
+            uplevel 1 [list {*}$original $name {*}$args]
+        } finally {
+            foreach { var orig ext } $saved {
+                # Keep the paths that were added by package indexes
+                set new [list]
+                foreach path [set $var] {
+                    if { $path ni $ext && $path ni $orig } {
+                        lappend new $path
+                    }
+                }
+                set $var [concat $orig $new]
+            }
+        }
+    }}
+    puts $fh "package unknown \[[list list ::apply $handler $root] \[package unknown\]\]"
+    close $fh
+
+    ::cookfs::Unmount $exe
+
+    return 1
+
+    } res opts
+
+    catch { close $fh }
+    catch { interp delete $interp }
+    catch { ::cookfs::Unmount $exe }
+
+    return -options $opts $res
+
+}
+
+# Runs the executable once with the COOKIT_TRACE environment variable to
+# record files from the root VFS that are used at startup (see main.c), and
+# rebuilds the VFS so that these files are stored in the first pages. Thus,
+# only these pages will be decompressed before the application starts.
+# Other files keep the compression of their original pages. The list of
+# startup files is saved in the VFS as cookit-startup.txt. The options
+# -pagesize, -smallfilesize, -smallfilebuffer and -textpagesize have
+# the same meaning as for ::cookit::wrap.
+proc ::cookit::relayout { exe compression args } {
+
+    # The same page options as in ::cookit::wrap. The timeout is in seconds.
+    set opts [dict merge [dict create \
+        -timeout 60 \
+        -textpagesize 0 \
+        -pagesize [expr { 1024 * 1024 }] \
+        -smallfilesize [expr { 1024 * 512 }] \
+        -smallfilebuffer [expr { 1024 * 1024 * 64 }] \
+    ] $args]
+    set textpagesize [dict get $opts -textpagesize]
+
+    set exe [file normalize $exe]
+
+    # The executable records the files only if COOKIT_TRACE matches
+    # the cookit.trace metadata. This metadata is not copied to the final
+    # executable below, so COOKIT_TRACE has no effect on it.
+    close [file tempfile trace]
+    set h [::cookfs::Mount $exe $exe]
+    $h setmetadata cookit.trace $trace
+    ::cookfs::Unmount $exe
+    set ::env(COOKIT_TRACE) $trace
+    # The application can fail without arguments, but it doesn't matter.
+    # We only need the list of files used until that moment.
+    catch { run_with_timeout $exe [dict get $opts -timeout] }
+    unset ::env(COOKIT_TRACE)
+
+    set fh [open $trace r]
+    fconfigure $fh -encoding utf-8
+    set traced [split [string trim [read $fh]] \n]
+    close $fh
+    file delete -force $trace
+
+    set temp "$exe.relayout"
+
+    set h [::cookfs::Mount -readonly $exe $exe]
+    # Keep metadata about wrapped files and wrap options for
+    # ::cookit::wrap -update
+    set meta [$h getmetadata cookit.files ""]
+    set meta_options [$h getmetadata cookit.options ""]
+
+    # make sure that we unmount $exe on any error
+    catch {
+
+    set fh [open $temp wb]
+    file attributes $exe -parts [list head $fh]
+    close $fh
+
+    set strip [llength [file split $exe]]
+    set files [list]
+    foreach path [recursive_glob $exe *] {
+        lappend files [file join {*}[lrange [file split $path] $strip end]]
+    }
+
+    # The package index and the main script are evaluated by C code
+    # and are not recorded.
+    set startup [list]
+    foreach file [list pkgindex.tcl main.tcl {*}$traced] {
+        if { $file in $files && $file ni $startup } {
+            lappend startup $file
+        }
+    }
+
+    # With automatic compression, startup files are compressed by lzma.
+    # However, incompressible startup files remain in uncompressed pages.
+    set startup_codec $compression
+    if { $compression eq "auto" } {
+        set startup_codec "lzma"
+    }
+
+    # Group other files by compression of their original pages and by
+    # file class. Empty files have no pages. They are copied together with
+    # startup files and don't change the range of startup pages.
+    set groups [dict create]
+    set incompressible [list]
+    set empty [list]
+    foreach file $files {
+        set blocks [file attributes [file join $exe $file] -blocks]
+        if { ![llength $blocks] } {
+            if { $file ni $startup } {
+                lappend empty $file
+            }
+            continue
+        }
+        set page [dict get [lindex $blocks 0] page]
+        set codec [dict get [file attributes $exe -pages $page] compression]
+        if { $file in $startup } {
+            if { $compression ne "auto" || $codec ne "none" } continue
+            lappend incompressible $file
+        }
+        dict lappend groups [list $codec [file_class $file]] $file
+    }
+    set startup_files [list]
+    foreach file $startup {
+        if { $file ni $incompressible } {
+            lappend startup_files $file
+        }
+    }
+
+    # The first session contains startup files
+    set sessions [list [list $startup_codec "" 1] \
+        [concat $startup_files $empty]]
+    dict for { group list } $groups {
+        lappend sessions [list {*}$group 0] $list
+    }
+
+    foreach { session list } $sessions {
+        lassign $session codec class is_startup
+        # Encoding files are stored in one large page the same way
+        # as in ::cookit::copy_tcl_runtime.
+        if { $class eq "encoding" } {
+            set pagesize [expr { 1024 * 1024 * 5 }]
+        } elseif { $textpagesize > 0 && $class in {script msgcat} } {
+            set pagesize $textpagesize
+        } else {
+            set pagesize [dict get $opts -pagesize]
+        }
+        set smallfilesize [dict get $opts -smallfilesize]
+        if { $codec eq "none" && $compression eq "auto" } {
+            set smallfilesize 0
+        }
+        set h [::cookfs::Mount $temp $temp -compression $codec \
+            -pagesize $pagesize \
+            -smallfilesize $smallfilesize \
+            -smallfilebuffer [dict get $opts -smallfilebuffer]]
+        foreach file $list {
+            set dir [file join $temp [file dirname $file]]
+            if { ![file isdirectory $dir] } {
+                file mkdir $dir
+            }
+            file copy [file join $exe $file] $dir
+        }
+        if { $is_startup } {
+            set fh [open [file join $temp cookit-startup.txt] w]
+            fconfigure $fh -encoding utf-8 -translation lf
+            puts -nonewline $fh [join $startup \n]
+            close $fh
+            if { $meta ne "" } {
+                $h setmetadata cookit.files $meta
+            }
+            if { $meta_options ne "" } {
+                $h setmetadata cookit.options $meta_options
+            }
+        }
+        ::cookfs::Unmount $temp
+    }
+
+    # Pages are stored in the archive in order after the stub. Save
+    # the range of pages with startup files. It is read ahead at startup
+    # when the COOKIT_READAHEAD environment variable is set (see main.c).
+    set h [::cookfs::Mount $temp $temp]
+    set last -1
+    foreach file $startup_files {
+        foreach block [file attributes [file join $temp $file] -blocks] {
+            set last [expr { max($last, [dict get $block page]) }]
+        }
+    }
+    set length 0
+    for { set i 0 } { $i <= $last } { incr i } {
+        incr length [dict get [file attributes $temp -pages $i] compsize]
+    }
+    if { $length } {
+        $h setmetadata cookit.startup \
+            [list [dict get [file attributes $temp -parts] headsize] $length]
+    }
+    ::cookfs::Unmount $temp
+
+    ::cookfs::Unmount $exe
+
+    file rename -force $temp $exe
+
+    } res opts
+
+    catch { close $fh }
+    catch { ::cookfs::Unmount $temp }
+    catch { ::cookfs::Unmount $exe }
+    catch { file delete -force $temp }
+
+    return -options $opts $res
+
+}
+
+# Runs the executable without arguments and with empty stdin, and waits
+# until it exits. Its output is discarded. If it doesn't exit within
+# the specified number of seconds, then it is killed. Returns 1 if
+# the executable has exited and 0 if it was killed.
+proc ::cookit::run_with_timeout { exe timeout } {
+
+    variable run
+
+    set chan [open |[list $exe << "" 2>@1] r]
+    fconfigure $chan -blocking 0 -translation binary
+    fileevent $chan readable [list ::apply {{ chan } {
+        read $chan
+        if { [eof $chan] } {
+            set ::cookit::run($chan) 1
+        }
+    }} $chan]
+    set timer [after [expr { int($timeout * 1000) }] \
+        [list set ::cookit::run($chan) 0]]
+
+    vwait ::cookit::run($chan)
+    after cancel $timer
+    set result $run($chan)
+    unset run($chan)
+
+    if { !$result } {
+        foreach pid [pid $chan] {
+            if { $::tcl_platform(platform) eq "windows" } {
+                catch { exec taskkill /F /T /PID $pid }
+            } else {
+                catch { exec kill -KILL $pid }
+            }
+        }
+    }
+    catch { close $chan }
+
+    return $result
+
+}
+
 proc ::cookit::ico_file_parse { file } {
 
     set fh [open $file r]
@@ -726,8 +1823,23 @@ proc ::cookit::wrap { main_script args } {
     set paths_input  [list]
     set paths_output [list]
     set compression  "lzma"
+    set runtime_compression ""
     set output       ""
     set stubfile     ""
+    set pkgindex     1
+    set relayout     0
+    set relayouttimeout 60
+    set threads      [cpucount]
+    set textpagesize 0
+    # Default mount options for other (not Tcl runtime) files:
+    # -pagesize: Use 1MB as the page size.
+    # -smallfilesize: If the file is larger than 512 KB, treat it as a separate file.
+    # -smallfilebuffer: Use a large smallbuffer (64MB) to efficiently sort all
+    #                   files before storing them to pages.
+    set pagesize        [expr { 1024 * 1024 }]
+    set smallfilesize   [expr { 1024 * 512 }]
+    set smallfilebuffer [expr { 1024 * 1024 * 64 }]
+    set update       0
     set windows_resources [dict create icon "" versionInfo [dict create]]
 
     if { $main_script eq "-" } {
@@ -755,7 +1867,7 @@ proc ::cookit::wrap { main_script args } {
                 if { [info exists paths] } {
                     foreach path $paths {
                         lappend paths_input $path
-                        lappend paths_output [file tail $path]
+                        lappend paths_output [path_tail $path]
                     }
                 }
                 set paths $val
@@ -764,7 +1876,7 @@ proc ::cookit::wrap { main_script args } {
                 if { [info exists paths] } {
                     foreach path $paths {
                         lappend paths_input $path
-                        lappend paths_output [file tail $path]
+                        lappend paths_output [path_tail $path]
                     }
                 }
                 set paths [list $val]
@@ -778,7 +1890,7 @@ proc ::cookit::wrap { main_script args } {
                 }
                 foreach path $paths {
                     lappend paths_input $path
-                    lappend paths_output [file join $val [file tail $path]]
+                    lappend paths_output [file join $val [path_tail $path]]
                 }
                 unset paths
             }
@@ -798,11 +1910,21 @@ proc ::cookit::wrap { main_script args } {
             }
             -package {
                 lappend paths_input $val
-                lappend paths_output [file join "lib" [file tail $val]]
+                lappend paths_output [file join "lib" [path_tail $val]]
             }
             -compression      { set compression $val }
+            -runtime-compression { set runtime_compression $val }
             -output           { set output      $val }
             -stubfile         { set stubfile    $val }
+            -pkgindex         { set pkgindex    $val }
+            -relayout         { set relayout    $val }
+            -relayouttimeout  { set relayouttimeout $val }
+            -threads          { set threads     $val }
+            -textpagesize     { set textpagesize $val }
+            -pagesize         { set pagesize    $val }
+            -smallfilesize    { set smallfilesize $val }
+            -smallfilebuffer  { set smallfilebuffer $val }
+            -update           { set update      $val }
             -icon             { dict set windows_resources icon $val }
             -company          { dict set windows_resources versionInfo company          $val }
             -copyright        { dict set windows_resources versionInfo copyright        $val }
@@ -822,7 +1944,7 @@ proc ::cookit::wrap { main_script args } {
     if { [info exists paths] } {
         foreach path $paths {
             lappend paths_input $path
-            lappend paths_output [file tail $path]
+            lappend paths_output [path_tail $path]
         }
         unset paths
     }
@@ -837,29 +1959,114 @@ proc ::cookit::wrap { main_script args } {
         }
     }
 
-    if { $stubfile ne "" } {
-        file copy -force $stubfile $output
-    } else {
-        makestub $output
+    # Options that affect the content of the executable other than
+    # the wrapped files. The stub and the icon are identified by their
+    # size and modification time. If no stub file is specified, then
+    # the stub is created from the current executable.
+    set stub [expr { $stubfile eq "" ? [info nameofexecutable] : $stubfile }]
+    set icon [dict get $windows_resources icon]
+    set options [dict create \
+        stub [list [file normalize $stub] [file size $stub] [file mtime $stub]] \
+        runtime-compression $runtime_compression \
+        resources [dict get $windows_resources versionInfo] \
+        icon [expr { $icon eq "" ? "" : [list [file normalize $icon] \
+            [file size $icon] [file mtime $icon]] }] \
+        compression $compression \
+        textpagesize $textpagesize \
+        pagesize $pagesize \
+        smallfilesize $smallfilesize \
+        smallfilebuffer $smallfilebuffer]
+
+    # In update mode, the stub and Windows resources of the existing
+    # executable are kept, and only changed files are added to its VFS.
+    # If the executable was wrapped with different options, then it is
+    # wrapped from scratch.
+    if { $update && ![is_updatable $output $options] } {
+        set update 0
     }
 
-    if { [is_pe_file $output] } {
-        windows_resources_update $output $windows_resources
+    if { !$update } {
+
+        if { $stubfile ne "" } {
+            file copy -force $stubfile $output
+        } else {
+            makestub $output $runtime_compression
+        }
+
+        if { [is_pe_file $output] } {
+            windows_resources_update $output $windows_resources
+        }
+
     }
 
     if { [llength $paths_input] } {
-        # Default mount options for other (not Tcl runtime) files:
-        # -pagesize: Use 1MB as the page size.
-        # -smallfilesize: If the file is larger than 512 KB, treat it as a separate file.
-        # -smallfilebuffer: Use a large smallbuffer (64MB) to efficiently sort all
-        #                   files before storing them to pages.
-        addfiles $output $paths_input $paths_output \
-            -compression $compression \
-            -pagesize [expr { 1024 * 1024 }] \
-            -smallfilesize [expr { 1024 * 512 }] \
-            -smallfilebuffer [expr { 1024 * 1024 * 64 }]
+
+        # Archives specified as <archive>!<path> are mounted, and their
+        # files are added directly from the archives.
+        set mounts [list]
+
+        # make sure that we unmount archives on any error
+        catch {
+
+            set files [list]
+            foreach path $paths_input {
+                if { ![llength [archive_split $path]] } {
+                    lappend files $path
+                    continue
+                }
+                lappend files [archive_mount $path mounts]
+                # Mounted archives are only available in this thread
+                set threads 1
+            }
+
+            addfiles $output $files $paths_output \
+                -threads $threads \
+                -update $update \
+                -textpagesize $textpagesize \
+                -compression $compression \
+                -pagesize $pagesize \
+                -smallfilesize $smallfilesize \
+                -smallfilebuffer $smallfilebuffer
+
+        } res opts
+
+        foreach mount $mounts {
+            archive_unmount $mount
+        }
+
+        if { [dict get $opts -code] } {
+            return -options $opts $res
+        }
+
+    }
+
+    if { $pkgindex } {
+        pkgindex_generate $output
+    }
+
+    # Save the options for the following ::cookit::wrap -update. Without
+    # relayout, the range of startup pages saved by an earlier relayout
+    # of the updated executable no longer matches its pages.
+    set exe [file normalize $output]
+    set h [::cookfs::Mount $exe $exe]
+    $h setmetadata cookit.options $options
+    if { !$relayout } {
+        $h setmetadata cookit.startup ""
+        file delete [file join $exe cookit-startup.txt]
+    }
+    ::cookfs::Unmount $exe
+
+    if { $relayout } {
+        set_exec_perms $output
+        relayout $output $compression \
+            -timeout $relayouttimeout \
+            -textpagesize $textpagesize \
+            -pagesize $pagesize \
+            -smallfilesize $smallfilesize \
+            -smallfilebuffer $smallfilebuffer
     }
 
+    buildid_set $output
     set_exec_perms $output
     return $output
 
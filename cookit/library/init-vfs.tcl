@@ -7,14 +7,18 @@
 
 set vfs_out     [lindex $argv 0]
 set vfs_content [lindex $argv 1]
+set compression [lindex $argv 2]
 set mnt "/mnt"
 
 puts "Initialize VFS..."
 puts "  content from: $vfs_content"
 puts "  destination: $vfs_out"
+if { $compression ne "" } {
+    puts "  compression: $compression"
+}
 
 # We need to get the default mount options for cookit (compression, smallfilesize)
 lappend auto_path [file normalize [file join $vfs_content lib]]
 package require cookit
 
-::cookit::copy_tcl_runtime [file join $vfs_content manifest.txt] $vfs_out
+::cookit::copy_tcl_runtime [file join $vfs_content manifest.txt] $vfs_out $compression
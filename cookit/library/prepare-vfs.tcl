@@ -16,6 +16,10 @@ if { [lindex $argv 0] eq "-console" } {
 set rootLibDirectory   [file dirname $tcl_library]
 set cookitLibDirectory [file dir [info script]]
 
+# Load the cookit library first to use its ::cookit::walk command.
+catch { load {} Cookit }
+source [file join $cookitLibDirectory cookit.tcl]
+
 puts "### Preparing VFS files from $rootLibDirectory to $destinationDirectory directory..."
 
 set filelist [list]
@@ -100,7 +104,7 @@ proc shrink_tcl { src dst } {
         }
     }
     if { [info exists prev] } {
-        lappend lines $line
+        lappend lines $prev
     }
 
     # Stage 2. Remove empty lines and comments.
@@ -198,11 +202,7 @@ proc directoryExists { dir { opt 0 } } {
 }
 
 proc findFiles { dir mask } {
-    set result [glob -nocomplain -type f -directory $dir $mask]
-    foreach subdir [glob -nocomplain -type d -directory $dir *] {
-        lappend result {*}[findFiles $subdir $mask]
-    }
-    return $result
+    return [::cookit::recursive_glob $dir $mask]
 }
 
 proc addTcl { { optional 0 } } {
@@ -456,6 +456,7 @@ proc addCookit { { optional 0 } } {
     addFile [file join $::cookitLibDirectory cookit-builtin.tcl] "" $dst
     addFile [file join $::cookitLibDirectory cookit-install.tcl] "" $dst
     addFile [file join $::cookitLibDirectory cookit-windows-postpone.tcl] "" $dst
+    addFile [file join $::cookitLibDirectory cookit-pool.tcl] "" $dst
     addFile [file join $::cookitLibDirectory wzipvfs.tcl] "" $dst
 
     load {} Cookfs
@@ -475,20 +476,12 @@ proc addCookit { { optional 0 } } {
 }
 
 proc makeManifest { } {
-    set rglob [list apply { { dir rglob } {
-        set result [glob -nocomplain -directory $dir -type f *]
-        foreach dir [glob -nocomplain -directory $dir -type d *] {
-            lappend result {*}[{*}$rglob $dir $rglob]
-        }
-        return $result
-    }}]
-
     set strip [llength [file split $::destinationDirectory]]
 
     set fh [open [file join $::destinationDirectory manifest.txt] w]
     fconfigure $fh -encoding utf-8 -translation lf
 
-    foreach file [{*}$rglob $::destinationDirectory $rglob] {
+    foreach file [::cookit::recursive_glob $::destinationDirectory *] {
         set file [file split $file]
         set file [lrange $file $strip end]
         set file [file join {*}$file]
@@ -175,14 +175,47 @@ proc vfs::zip::open { fd name mode permissions } {
             vfs::filesystem posixerror $::vfs::posix(ENOSYS)
         }
         set exists 1
+        # the content of the file that is still being written is not
+        # in the archive yet
+        upvar #0 zip::$fd.toc toc
+        set entry $toc([string tolower $name])
+        if { [zip::busy $entry] } {
+            vfs::filesystem posixerror $::vfs::posix(EBUSY)
+        }
     } {
         if { $mode eq "r+" } {
             vfs::filesystem posixerror $::vfs::posix(ENOENT)
         }
     }
 
-    if { [zip::locked $fd] } {
-        vfs::filesystem posixerror $::vfs::posix(EMFILE)
+    # Files opened only for writing are compressed and written to
+    # the archive as data arrives. Files that can be read or seeked are
+    # buffered in memory and written to the archive when they are closed.
+    # The old content of appended files is decompressed in chunks and
+    # passed to the new entry.
+    if { $mode in { w a } } {
+
+        if { $exists } {
+            zip::del_entry $fd $name
+        }
+        zip::add_entry $fd file $name $permissions
+        set id [zip::writer_start $fd $name]
+
+        # put back the original entry if its content can't be read
+        if { $exists && $mode eq "a" && [catch {
+            zip::copy_entry $fd $entry [list zip::writer_put $id]
+        } res opts] } {
+            zip::writer_abort $id
+            zip::del_entry $fd $name
+            zip::restore_entry $fd $name $entry
+            return -options $opts $res
+        }
+
+        set chan [chan create write [list vfs::zip::wchan $id]]
+        fconfigure $chan -translation binary -buffersize $::zip::chunksize
+
+        return [list $chan]
+
     }
 
     set chan [vfs::memchan]
@@ -190,10 +223,13 @@ proc vfs::zip::open { fd name mode permissions } {
     fconfigure $chan -translation binary -buffersize 262144
 
     if { $exists } {
-        if { $mode in { r+ a+ a } } {
-            set h [open $fd $name r]
-            fcopy $h $chan
-            close $h
+        if { $mode in { r+ a+ } } {
+            if { [catch {
+                zip::copy_entry $fd $entry [list puts -nonewline $chan]
+            } res opts] } {
+                close $chan
+                return -options $opts $res
+            }
 
             if { $mode eq "r+" } {
                 seek $chan 0 start
@@ -204,8 +240,6 @@ proc vfs::zip::open { fd name mode permissions } {
 
     zip::add_entry $fd file $name $permissions
 
-    zip::locked $fd true
-
     return [list $chan [list vfs::zip::on_close $fd $name $chan]]
 
 }
@@ -214,11 +248,46 @@ proc vfs::zip::on_close { fd name chan } {
     upvar #0 zip::$fd cb
     upvar #0 zip::$fd.toc toc
     zip::update_entry $fd $name channel $chan
-    zip::locked $fd false
+}
+
+# Handler of the channel that writes the file content directly to the archive
+proc vfs::zip::wchan { id cmd chan args } {
+    switch -exact -- $cmd {
+        initialize {
+            return [list initialize finalize watch write]
+        }
+        write {
+            set data [lindex $args 0]
+            zip::writer_put $id $data
+            return [string length $data]
+        }
+        finalize {
+            zip::writer_finish $id
+        }
+        watch {}
+    }
+}
+
+# Removes the space left by deleted and replaced files in the writable
+# archive mounted at the specified mount point, and returns the number of
+# reclaimed bytes.
+proc vfs::zip::compact { local } {
+    set fd [lindex [vfs::filesystem info $local] end]
+    if { ![zip::writable $fd] } {
+        vfs::filesystem posixerror $::vfs::posix(EROFS)
+    }
+    return [zip::compact $fd]
 }
 
 ##### zip
 
+namespace eval zip {
+    # The size of the buffer used to add file content to the archive
+    variable chunksize 65536
+    # The counter of writer identifiers
+    variable writers 0
+}
+
 proc zip::TimeDos { datetime } {
     set s [clock format $datetime -format {%Y %m %e %k %M %S}]
     scan $s {%d %d %d %d %d %d} year month day hour min sec
@@ -319,6 +388,7 @@ proc zip::create_toc { args } {
     # vem     unix ($zip::systems(3) -> unix) + version 2.3 (23)
     # flags   [expr { (1<<11) }] - utf-8 comment and path
     # ino     -1                 - will be updated by write_lfheader
+    # writer  {}                 - the writer of the file content
     array set toc [list            \
         vem     [expr { ( 3 << 8 ) | 23 }] \
         ver     20                 \
@@ -338,6 +408,7 @@ proc zip::create_toc { args } {
         depth   0                  \
         mode    0                  \
         atx     0                  \
+        writer  {}                 \
     ]
     array set toc $args
     if { $toc(type) eq "directory" } {
@@ -350,18 +421,6 @@ proc zip::create_toc { args } {
     return [array get toc]
 }
 
-proc zip::locked { fd { state {} } } {
-    upvar #0 zip::$fd cb
-    if { $state ne "" } {
-        if { $state } {
-            set cb(locked) 1
-        } {
-            unset -nocomplain cb(locked)
-        }
-    }
-    return [info exists cb(locked)]
-}
-
 proc zip::writable { fd { state {} } } {
     upvar #0 zip::$fd cb
     if { $state ne "" } {
@@ -379,16 +438,37 @@ proc zip::updated { fd } {
     set cb(updated) 1
 }
 
+# Marks the entry as changed. Its record in the central directory will be
+# regenerated when the archive is closed. The original record, if any, will
+# be dropped from the central directory that was read when the archive
+# was opened.
+proc zip::dirty { fd path } {
+    upvar #0 zip::$fd cb
+    upvar #0 zip::$fd.toc toc
+    if { [info exists toc($path)] && [dict exists $toc($path) cdoff] } {
+        lappend cb(stale) [list \
+            [dict get $toc($path) cdoff] [dict get $toc($path) cdlen]]
+        dict unset toc($path) cdoff
+    }
+    dict set cb(dirty) $path 1
+    updated $fd
+}
+
 proc zip::add_entry { fd type name permissions } {
     upvar #0 zip::$fd.toc toc
     upvar #0 zip::$fd.dir cbdir
     set path [string tolower $name]
+    dirty $fd $path
     set toc($path) [create_toc \
         type $type             \
         mode $permissions      \
         name $name             \
     ]
-    write_lfheader $fd $path
+    # The local header of a file is written by its writer, when the file
+    # content is written
+    if { $type eq "directory" } {
+        commit $fd [list directory $path]
+    }
     set parent [file dirname $name]
     if { $parent eq "." } { set parent "" }
     lappend cbdir($parent) [file tail $name]
@@ -399,6 +479,7 @@ proc zip::del_entry { fd name } {
     upvar #0 zip::$fd.toc toc
     upvar #0 zip::$fd.dir cbdir
     set path [string tolower $name]
+    dirty $fd $path
     if { [dict get $toc($path) ino] != -1 } {
         incr cb(nitems) -1
         incr cb(ntotal) -1
@@ -411,7 +492,35 @@ proc zip::del_entry { fd name } {
     if { $pos != -1 } {
         set cbdir($parent) [lreplace $cbdir($parent) $pos $pos]
     }
-    updated $fd
+}
+
+# Puts back the entry of the existing file removed by del_entry
+proc zip::restore_entry { fd name entry } {
+    upvar #0 zip::$fd cb
+    upvar #0 zip::$fd.toc toc
+    upvar #0 zip::$fd.dir cbdir
+    set path [string tolower $name]
+    # the original record in the central directory is already dropped
+    dirty $fd $path
+    dict unset entry cdoff
+    set toc($path) $entry
+    incr cb(nitems)
+    incr cb(ntotal)
+    set parent [file dirname $name]
+    if { $parent eq "." } { set parent "" }
+    lappend cbdir($parent) [file tail $name]
+}
+
+# Returns true if the content of the entry is still being written
+proc zip::busy { entry } {
+    if { [dict get $entry ino] == -1 } {
+        return 1
+    }
+    # the local header of the file written directly to the end of
+    # the archive is written when its writer starts
+    # entries read from the archive have no writer
+    return [expr { [dict exists $entry writer]
+        && [info exists ::zip::[dict get $entry writer]] }]
 }
 
 if { ![llength [info commands zip::EndOfArchive_orig]] } {
@@ -440,8 +549,19 @@ proc zip::_close { fd } {
     if { [info exists cb(updated)] } {
         set start [expr { $cb(base) + $cb(coff) }]
         seek $fd $start start
-        foreach path [array names toc] {
-            # skip fake directory records
+        # Records of unchanged entries are copied as is from the central
+        # directory that was read when the archive was opened. Only records
+        # of changed and new entries are generated.
+        set pos 0
+        foreach range [lsort -integer -index 0 $cb(stale)] {
+            lassign $range offset length
+            puts -nonewline $fd [string range $cb(cdblob) $pos $offset-1]
+            set pos [expr { $offset + $length }]
+        }
+        puts -nonewline $fd [string range $cb(cdblob) $pos end]
+        foreach path [dict keys $cb(dirty)] {
+            # skip deleted entries and fake directory records
+            if { ![info exists toc($path)] } continue
             if { [dict get $toc($path) ino] == -1 } continue
             write_toc $fd $path
         }
@@ -453,10 +573,336 @@ proc zip::_close { fd } {
     tailcall ::zip::_close_orig $fd
 }
 
-proc zip::update_entry { fd name update_type data } {
+# Moves the entries forward to the space left by deleted and replaced files
+# and truncates the archive. The entry data is moved as is, without
+# decompression, in chunks of fixed size. Returns the number of reclaimed
+# bytes.
+proc zip::compact { fd } {
+    variable chunksize
     upvar #0 zip::$fd cb
     upvar #0 zip::$fd.toc toc
 
+    if { [info exists cb(tail)] || [llength $cb(pending)] } {
+        return -code error "the archive has files opened for writing"
+    }
+
+    set entries [list]
+    foreach path [array names toc] {
+        # skip fake directory records
+        if { [dict get $toc($path) ino] == -1 } continue
+        lappend entries [list [dict get $toc($path) ino] $path]
+    }
+
+    set pos $cb(start)
+    foreach entry [lsort -integer -index 0 $entries] {
+        lassign $entry ino path
+
+        set size [expr { [lfh_size $fd $ino] + [dict get $toc($path) csize] }]
+
+        # the data descriptor after the data
+        if { [dict get $toc($path) flags] & 0x8 } {
+            seek $fd [expr { $ino + $size }] start
+            if { [read $fd 4] eq "PK\07\10" } {
+                incr size 16
+            } {
+                incr size 12
+            }
+        }
+
+        if { $ino != $pos } {
+            set from $ino
+            set to $pos
+            set left $size
+            while { $left } {
+                seek $fd $from start
+                set data [read $fd [expr { min($left, $chunksize) }]]
+                seek $fd $to start
+                puts -nonewline $fd $data
+                set len [string length $data]
+                incr from $len
+                incr to $len
+                incr left -$len
+            }
+            dict set toc($path) ino $pos
+            dirty $fd $path
+        }
+
+        incr pos $size
+    }
+
+    set reclaimed [expr { $cb(base) + $cb(coff) - $pos }]
+    set cb(coff) [expr { $pos - $cb(base) }]
+    seek $fd $pos start
+    chan truncate $fd
+    updated $fd
+
+    return $reclaimed
+}
+
+# Returns the size of the local header at the specified offset
+proc zip::lfh_size { fd ino } {
+    seek $fd $ino start
+    binary scan [read $fd 30] a4x22ss hdr nlen elen
+    if { ![info exists hdr] || $hdr ne "PK\03\04" } {
+        return -code error "bad local header at offset $ino"
+    }
+    return [expr { 30 + ($nlen & 0xffff) + ($elen & 0xffff) }]
+}
+
+# Reads the content of the entry, which is specified by its record in toc,
+# and passes it in chunks of limited size to the command prefix. Stored and
+# deflated entries are supported.
+proc zip::copy_entry { fd entry cmd } {
+    variable chunksize
+    set ino [dict get $entry ino]
+    set pos [expr { $ino + [lfh_size $fd $ino] }]
+    set left [dict get $entry csize]
+    switch -exact -- [dict get $entry method] {
+        0 { set zstream "" }
+        8 { set zstream [zlib stream inflate] }
+        default {
+            return -code error "unsupported compression method:\
+                [dict get $entry method]"
+        }
+    }
+    catch {
+        while { $left > 0 } {
+            # the command can move the position in the archive
+            seek $fd $pos start
+            set data [read $fd [expr { min($left, $chunksize) }]]
+            if { ![set len [string length $data]] } {
+                return -code error "unexpected end of archive"
+            }
+            incr pos $len
+            incr left -$len
+            if { $zstream eq "" } {
+                {*}$cmd $data
+                continue
+            }
+            if { $left } {
+                $zstream put $data
+            } {
+                $zstream put -finalize $data
+            }
+            while { [string length [set data [$zstream get $chunksize]]] } {
+                {*}$cmd $data
+            }
+        }
+    } res opts
+    if { $zstream ne "" } {
+        $zstream close
+    }
+    return -options $opts $res
+}
+
+# Starts writing the content of the entry and returns the writer identifier.
+# The content is passed to writer_put in parts of any size, and
+# writer_finish completes the entry.
+#
+# The content is processed in chunks of fixed size, so the memory usage
+# doesn't depend on the file size. The compression method is selected by
+# the first chunk. If it is compressed by less than 5%, the whole file is
+# stored as is.
+#
+# Only one writer at a time can write directly to the end of the archive.
+# Other writers spool the compressed content to their own temporary files,
+# which are appended to the archive by zip::commit in the order they are
+# finished.
+proc zip::writer_start { fd name } {
+    variable writers
+    upvar #0 zip::$fd cb
+    upvar #0 zip::$fd.toc toc
+    set path [string tolower $name]
+    set id "zipwriter[incr writers]"
+    upvar #0 zip::$id w
+    array set w [list    \
+        fd      $fd      \
+        path    $path    \
+        buffer  {}       \
+        method  {}       \
+        zstream {}       \
+        crc     0        \
+        size    0        \
+        csize   0        \
+    ]
+    dict set toc($path) writer $id
+    if { [info exists cb(tail)] } {
+        set w(chan) [file tempfile w(spool)]
+        fconfigure $w(chan) -translation binary
+        set w(offset) 0
+    } {
+        set cb(tail) $id
+        write_lfheader $fd $path
+        set w(chan) $fd
+        set w(offset) [expr {
+            [dict get $toc($path) ino] + [dict get $toc($path) lfh]
+        }]
+    }
+    return $id
+}
+
+proc zip::writer_put { id data } {
+    variable chunksize
+    upvar #0 zip::$id w
+    if { $w(method) eq "" } {
+        append w(buffer) $data
+        if { [string length $w(buffer)] < $chunksize } {
+            return
+        }
+        writer_method $id
+        set data $w(buffer)
+        set w(buffer) {}
+    }
+    writer_write $id $data 0
+}
+
+proc zip::writer_finish { id } {
+    upvar #0 zip::$id w
+    upvar #0 zip::$w(fd) cb
+    upvar #0 zip::$w(fd).toc toc
+    set data {}
+    if { $w(method) eq "" } {
+        writer_method $id
+        set data $w(buffer)
+        set w(buffer) {}
+    }
+    writer_write $id $data 1
+    if { $w(zstream) ne "" } {
+        $w(zstream) close
+    }
+    set fd $w(fd)
+    set path $w(path)
+    # the entry could be deleted or replaced while it was written
+    set alive [expr {
+        [info exists toc($path)] && [dict get $toc($path) writer] eq $id
+    }]
+    if { $alive } {
+        dict set toc($path) method $w(method)
+        dict set toc($path) size   $w(size)
+        dict set toc($path) crc    $w(crc)
+        dict set toc($path) csize  $w(csize)
+        dict set toc($path) mtime  [clock seconds]
+    }
+    if { $w(chan) ne $fd } {
+        seek $w(chan) 0 start
+        commit $fd [list spool $id]
+        return
+    }
+    if { $alive } {
+        write_lfheader $fd $path $w(csize)
+    } {
+        incr cb(coff) $w(csize)
+    }
+    unset cb(tail)
+    unset w
+    commit $fd
+}
+
+# Discards the content passed to the writer. The entry of the writer is
+# left as is and should be deleted by the caller.
+proc zip::writer_abort { id } {
+    upvar #0 zip::$id w
+    upvar #0 zip::$w(fd) cb
+    if { $w(zstream) ne "" } {
+        $w(zstream) close
+    }
+    set fd $w(fd)
+    if { $w(chan) ne $fd } {
+        close $w(chan)
+        file delete $w(spool)
+        unset w
+        return
+    }
+    unset cb(tail)
+    unset w
+    commit $fd
+}
+
+# Adds the record to the queue of records to be appended to the archive,
+# and appends the queued records if no writer is writing directly to the end
+# of the archive. The record is a list of its type and argument:
+#   directory <path> - the local header of the directory entry
+#   spool <writer>   - the content spooled by the writer
+proc zip::commit { fd { record {} } } {
+    upvar #0 zip::$fd cb
+    upvar #0 zip::$fd.toc toc
+    if { [llength $record] } {
+        lappend cb(pending) $record
+    }
+    while { ![info exists cb(tail)] && [llength $cb(pending)] } {
+        set cb(pending) [lassign $cb(pending) record]
+        lassign $record type arg
+        if { $type eq "directory" } {
+            if { [info exists toc($arg)] && [dict get $toc($arg) ino] == -1 } {
+                write_lfheader $fd $arg
+            }
+            continue
+        }
+        upvar #0 zip::$arg w
+        if { [info exists toc($w(path))]
+                && [dict get $toc($w(path)) writer] eq $arg } {
+            write_lfheader $fd $w(path)
+            seek $fd [expr {
+                [dict get $toc($w(path)) ino] + [dict get $toc($w(path)) lfh]
+            }] start
+            fcopy $w(chan) $fd
+        }
+        close $w(chan)
+        file delete $w(spool)
+        unset w
+    }
+}
+
+proc zip::writer_method { id } {
+    upvar #0 zip::$id w
+    set len [string length $w(buffer)]
+    if { $len && [string length [zlib deflate $w(buffer)]] < 0.95 * $len } {
+        set w(method) 8
+        set w(zstream) [zlib stream deflate]
+    } {
+        set w(method) 0
+    }
+}
+
+proc zip::writer_write { id data final } {
+    upvar #0 zip::$id w
+    set w(crc) [zlib crc32 $data $w(crc)]
+    incr w(size) [string length $data]
+    if { $w(zstream) ne "" } {
+        if { $final } {
+            $w(zstream) put -finalize $data
+        } {
+            $w(zstream) put $data
+        }
+        set data [$w(zstream) get]
+    }
+    if { [set len [string length $data]] } {
+        # other channels can move the position in the archive
+        seek $w(chan) $w(offset) start
+        puts -nonewline $w(chan) $data
+        incr w(offset) $len
+        incr w(csize) $len
+    }
+}
+
+# Reads the next chunk of the file content from the channel or from the data
+# and advances the offset.
+proc zip::read_chunk { source type offsetVar } {
+    variable chunksize
+    upvar 1 $offsetVar offset
+    if { $type eq "data" } {
+        set chunk [string range $source $offset \
+            [expr { $offset + $chunksize - 1 }]]
+    } {
+        set chunk [read $source $chunksize]
+    }
+    incr offset [string length $chunk]
+    return $chunk
+}
+
+proc zip::update_entry { fd name update_type data } {
+    upvar #0 zip::$fd.toc toc
+
     set path [string tolower $name]
 
     set mtime [clock seconds]
@@ -471,81 +917,28 @@ proc zip::update_entry { fd name update_type data } {
         switch -- $update_type {
             file {
                 set mtime [file mtime $data]
-                set size [file size $data]
-                set chan [open $data r]
+                set data [::open $data rb]
             }
             channel {
-                set chan $data
-                seek $chan 0 end
-                set size [tell $chan]
-                seek $chan 0 start
-            }
-            data {
-                set size [string length $data]
+                seek $data 0 start
             }
         }
 
-        dict set toc($path) size $size
-
-        seek $fd [expr {
-            $cb(base)
-            + [dict get $toc($path) ino]
-            + [dict get $toc($path) lfh]
-        }] start
-
-        # deflate is the default
-        dict set toc($path) method 8
-        # Don't try to compress already compressed files smaller
-        # than 2 MB.
-        if { $size < 0x2000000 || $update_type eq "data" } {
-            if { [info exists chan] } {
-                set data [read $chan]
-            }
-            set crc [zlib crc32 $data]
-            set cdata [zlib deflate $data]
-            set csize [string length $cdata]
-            # compression ratio is less than 95%
-            if { 1.0 * $csize / $size >= 0.95 } {
-                dict set toc($path) method 0
-                set cdata $data
-                set csize $size
-            }
-            puts -nonewline $fd $cdata
-        } {
-            # compress large files regardless of compression ratio
-            set crc 0
-            set csize 0
-            set zstream [zlib stream deflate]
-            while { ![eof $chan] } {
-                set data [read $chan 4096]
-                set crc  [zlib crc32 $data $crc]
-                $zstream put $data
-                set cdata [$zstream get]
-                if { [set len [string length $cdata]] } {
-                    puts -nonewline $fd $cdata
-                    incr csize $len
-                }
-            }
-            $zstream finalize
-            set cdata [$zstream get]
-            if { [set len [string length $cdata]] } {
-                puts -nonewline $fd $cdata
-                incr csize $len
-            }
-            $zstream close
+        set id [writer_start $fd $name]
+        set offset 0
+        while { [string length [set chunk [read_chunk $data $update_type offset]]] } {
+            writer_put $id $chunk
         }
+        writer_finish $id
 
         if { $update_type eq "file" } {
-            close $chan
+            close $data
         }
 
-        dict set toc($path) crc $crc
-        write_lfheader $fd $path $csize
-
     }
     dict set toc($path) mtime $mtime
 
-    updated $fd
+    dirty $fd $path
 }
 
 if { ![llength [info commands ::zip::open_orig]] } {
@@ -577,12 +970,17 @@ proc zip::open { path { mode "" } } {
             csize   0
             coff    0
             comment {}
+            pending {}
+            cdblob  {}
+            stale   {}
+            dirty   {}
         }
         if { $mode eq "append" } {
             set cb(base) [file size $path]
         } {
             set cb(base) 0
         }
+        set cb(start) $cb(base)
         array set toc {}
         array set cbdir {}
     } {
@@ -593,13 +991,29 @@ proc zip::open { path { mode "" } } {
             upvar #0 zip::$fd.dir cbdir
 
             zip::EndOfArchive $fd cb
-
-            seek $fd [expr { $cb(base) + $cb(coff) }] start
+            set cb(pending) {}
+            set cb(stale) {}
+            set cb(dirty) {}
+
+            set cdstart [expr { $cb(base) + $cb(coff) }]
+            # The start of the first entry. The data before it, for
+            # example an executable, doesn't belong to the archive.
+            set cb(start) $cdstart
+            seek $fd $cdstart start
+            set cb(cdblob) [read $fd $cb(csize)]
+            seek $fd $cdstart start
 
             array set toc [list]
 
             for { set i 0 } { $i < $cb(nitems) } { incr i } {
+                set offset [expr { [tell $fd] - $cdstart }]
                 zip::TOC $fd sb
+                # the location of the record in the central directory
+                set sb(cdoff) $offset
+                set sb(cdlen) [expr { [tell $fd] - $cdstart - $offset }]
+                if { $sb(ino) < $cb(start) } {
+                    set cb(start) $sb(ino)
+                }
 
                 set origname [string trimright $sb(name) /]
                 set sb(depth) [llength [file split $sb(name)]]
@@ -643,7 +1057,7 @@ proc zip::attribute { fd name attr args } {
                 ([dict get $toc($path) mode] & 0o177000) |
                 ($val & 0o777)
             }]
-            updated $fd
+            dirty $fd $path
         }
         return [format {0o%o} [dict get $toc($path) mode]]
     }
@@ -668,7 +1082,7 @@ proc zip::attribute { fd name attr args } {
         } else {
             dict set toc($path) atx [expr { [dict get $toc($path) atx] & (0xff ^ $bit) }]
         }
-        updated $fd
+        dirty $fd $path
     }
 
     return [expr { ([dict get $toc($path) atx] & $bit) != 0 }]
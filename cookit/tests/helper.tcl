@@ -19,4 +19,25 @@ if { $::tcl_platform(platform) eq "windows" } {
 
 proc getfile { fn } { return [read [set f [open $fn rb]]][close $f] }
 
+# Waits up to the specified number of seconds until files matching
+# the pattern appear in the directory. Returns the list of matching files.
+proc waitfiles { dir pattern { timeout 30 } } {
+    set end [expr { [clock seconds] + $timeout }]
+    while { ![llength [set files [glob -nocomplain -directory $dir $pattern]]] } {
+        if { [clock seconds] > $end } break
+        after 100
+    }
+    return $files
+}
+
+# Waits up to the specified number of seconds until no files matching
+# the pattern remain in the directory.
+proc waitnofiles { dir pattern { timeout 30 } } {
+    set end [expr { [clock seconds] + $timeout }]
+    while { [llength [glob -nocomplain -directory $dir $pattern]] } {
+        if { [clock seconds] > $end } break
+        after 100
+    }
+}
+
 
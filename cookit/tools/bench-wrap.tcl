@@ -0,0 +1,318 @@
+# cookit - benchmark of ::cookit::wrap
+#
+# Copyright (C) 2024 Konstantin Kushnir <chpock@gmail.com>
+#
+# See the file "license.terms" for information on usage and redistribution of
+# this file, and for a DISCLAIMER OF ALL WARRANTIES.
+#
+# Wraps a fixed synthetic corpus with each combination of the specified
+# compression methods and page options, and writes the results to a file
+# with tab-separated values. The first line of the file is the header.
+#
+# Usage: cookit bench-wrap.tcl ?options?
+#
+# Options:
+#   -output <file>            - the results file, bench-wrap.txt by default
+#   -workdir <dir>            - the directory for the corpus and temporary
+#                               files, by default a new temporary directory
+#   -compression <list>       - compression methods, by default all methods
+#                               supported by cookfs in this build
+#   -pagesize <list>          - page sizes
+#   -smallfilesize <list>     - small file sizes
+#   -smallfilebuffer <list>   - small file buffer sizes
+#
+# Columns of the results file:
+#   compression, pagesize, smallfilesize, smallfilebuffer - wrap options
+#   wall_ms    - wall time of the wrap
+#   cpu_ms     - CPU time of the wrap in all threads (Linux only)
+#   rss_kb     - peak RSS of the process that runs the wrap (Linux only)
+#   size       - the size of the output executable
+#   run_ms     - wall time of running the output executable
+#   script_warm_us - the first read of a small script from the output
+#                executable
+#   binary_warm_us - the first read of a large binary file from the output
+#                executable
+#
+# The output executable has just been written, so it is in the OS page
+# cache when it is run. Thus, run_ms and *_warm_us columns measure
+# decompression of pages, but not reading them from the disk.
+#
+# If the wrap or the run fails, then the row contains "failed" in
+# the wall_ms column and the error message in the last column.
+
+package require cookit
+
+# The script that runs in a child process for each wrap. It prints a list
+# of the wall time, CPU time and peak RSS.
+proc child { corpus stub output compression pagesize smallfilesize smallfilebuffer } {
+
+    set start [clock milliseconds]
+
+    ::cookit::wrap [file join $corpus main.tcl] \
+        -path [file join $corpus data] \
+        -output $output \
+        -stubfile $stub \
+        -compression $compression \
+        -pagesize $pagesize \
+        -smallfilesize $smallfilesize \
+        -smallfilebuffer $smallfilebuffer
+
+    set wall [expr { [clock milliseconds] - $start }]
+
+    # Linux reports the CPU time in clock ticks. It is 100 ticks per second
+    # on all supported platforms.
+    set cpu ""
+    set rss ""
+    if { ![catch { open /proc/self/stat r } fh] } {
+        set stat [read $fh]
+        close $fh
+        set stat [string range $stat [string last ")" $stat]+2 end]
+        set cpu [expr { ([lindex $stat 11] + [lindex $stat 12]) * 10 }]
+    }
+    if { ![catch { open /proc/self/status r } fh] } {
+        foreach line [split [read $fh] \n] {
+            if { [regexp {^VmHWM:\s+(\d+)} $line -> rss] } break
+        }
+        close $fh
+    }
+
+    puts [list $wall $cpu $rss]
+
+}
+
+if { [lindex $argv 0] eq "-child" } {
+    child {*}[lrange $argv 1 end]
+    exit 0
+}
+
+proc random_bytes { count } {
+    set result ""
+    for { set i 0 } { $i < $count } { incr i 4 } {
+        append result [binary format i [expr { int(rand() * 0xFFFFFFFF) }]]
+    }
+    return [string range $result 0 $count-1]
+}
+
+proc write_file { file data { binary 0 } } {
+    file mkdir [file dirname $file]
+    set fh [open $file [expr { $binary ? "wb" : "w" }]]
+    if { !$binary } {
+        fconfigure $fh -encoding utf-8 -translation lf
+    }
+    puts -nonewline $fh $data
+    close $fh
+}
+
+# Creates the corpus. The same corpus is created on each run, as
+# the random number generator is initialized with a fixed seed.
+proc make_corpus { dir } {
+
+    expr { srand(20241017) }
+
+    set words {
+        set if else foreach while return proc namespace variable upvar
+        dict list lappend string length index range expr incr append
+        file join open close read puts gets format regexp regsub catch
+    }
+
+    set data [file join $dir data]
+
+    # Many small Tcl scripts in packages
+    for { set pkg 0 } { $pkg < 40 } { incr pkg } {
+        set pkgdir [file join $data lib pkg$pkg]
+        write_file [file join $pkgdir pkgIndex.tcl] "package ifneeded pkg$pkg 1.0\
+            \[list source \[file join \$dir file0.tcl\]\]\n"
+        for { set i 0 } { $i < 50 } { incr i } {
+            set script "# Package pkg$pkg, file $i\n"
+            set size [expr { 200 + int(rand() * 4000) }]
+            while { [string length $script] < $size } {
+                append script "proc ::pkg${pkg}::proc$i[string length $script] { args } {\n"
+                for { set j 0 } { $j < 5 } { incr j } {
+                    append script "    [lindex $words [expr { int(rand() * [llength $words]) }]]\
+                        \$arg$j [expr { int(rand() * 1000) }]\n"
+                }
+                append script "}\n"
+            }
+            write_file [file join $pkgdir file$i.tcl] $script
+        }
+        for { set i 0 } { $i < 3 } { incr i } {
+            set msgs ""
+            for { set j 0 } { $j < 50 } { incr j } {
+                append msgs "::msgcat::mcset lang$i key$j \"Message $j for package $pkg\"\n"
+            }
+            write_file [file join $pkgdir msgs lang$i.msg] $msgs
+        }
+    }
+
+    # Large binary files. They consist of incompressible blocks, blocks
+    # repeated from other parts of the file and structured records.
+    set block [random_bytes 65536]
+    for { set i 0 } { $i < 4 } { incr i } {
+        set binary ""
+        while { [string length $binary] < 4 * 1024 * 1024 } {
+            switch -exact -- [expr { int(rand() * 3) }] {
+                0 {
+                    append binary [random_bytes 16384]
+                }
+                1 {
+                    set offset [expr { int(rand() * 32768) }]
+                    append binary [string range $block $offset $offset+32767]
+                }
+                2 {
+                    for { set j 0 } { $j < 1024 } { incr j } {
+                        append binary [binary format iisa8 $j \
+                            [expr { int(rand() * 100) }] $i record]
+                    }
+                }
+            }
+        }
+        write_file [file join $data binary bin$i.dat] $binary 1
+    }
+
+    # Already compressed media files
+    for { set i 0 } { $i < 40 } { incr i } {
+        write_file [file join $data media image$i.png] \
+            "\x89PNG\r\n\x1a\n[random_bytes 262144]" 1
+    }
+    for { set i 0 } { $i < 10 } { incr i } {
+        set text ""
+        for { set j 0 } { $j < 20000 } { incr j } {
+            append text "line $j of archive $i: [expr { int(rand() * 1000) }]\n"
+        }
+        write_file [file join $data media archive$i.gz] [zlib gzip $text] 1
+    }
+
+    # Encodings from the Tcl runtime
+    set encodings [glob -nocomplain -directory \
+        [file join $::cookit::root lib tcl[info tclversion] encoding] *.enc]
+    if { [llength $encodings] } {
+        file mkdir [file join $data encoding]
+        file copy {*}$encodings [file join $data encoding]
+    }
+
+    # The main script measures the first read of files from the VFS
+    write_file [file join $dir main.tcl] {
+        set root [file join $::cookit::root data]
+        set result [list]
+        foreach { file mode } { lib/pkg0/file0.tcl r binary/bin0.dat rb } {
+            set start [clock microseconds]
+            set fh [open [file join $root $file] $mode]
+            read $fh
+            close $fh
+            lappend result [expr { [clock microseconds] - $start }]
+        }
+        puts $result
+    }
+
+}
+
+# Returns compression methods supported by cookfs in this build. For
+# example, zstd is only available when Cookit is built with --enable-zstd.
+proc available_compressions { dir } {
+    set result [list]
+    foreach compression { none zlib lzma zstd } {
+        set file [file join $dir probe.cfs]
+        if { ![catch { ::cookfs::Mount $file $file -compression $compression }] } {
+            ::cookfs::Unmount $file
+            lappend result $compression
+        }
+        file delete -force $file
+    }
+    lappend result auto
+    return $result
+}
+
+set options [dict create \
+    -output          bench-wrap.txt \
+    -workdir         "" \
+    -compression     "" \
+    -pagesize        {262144 1048576 4194304} \
+    -smallfilesize   {65536 524288} \
+    -smallfilebuffer {67108864} \
+]
+
+foreach { arg val } $argv {
+    if { ![dict exists $options $arg] } {
+        puts stderr "Error: unknown option \"$arg\""
+        puts stderr "Known options are: [join [dict keys $options] {, }]"
+        exit 1
+    }
+    dict set options $arg $val
+}
+
+set workdir [dict get $options -workdir]
+if { $workdir eq "" } {
+    close [file tempfile temp]
+    file delete $temp
+    set workdir [file join [file dirname $temp] cookit-bench-[pid]]
+    set cleanup 1
+} else {
+    set cleanup 0
+}
+
+set corpus [file join $workdir corpus]
+set stub   [file join $workdir stub[file extension [info nameofexecutable]]]
+set output [file join $workdir output[file extension [info nameofexecutable]]]
+
+if { [dict get $options -compression] eq "" } {
+    file mkdir $workdir
+    dict set options -compression [available_compressions $workdir]
+}
+
+if { ![file isdirectory $corpus] } {
+    puts "Creating corpus in $corpus ..."
+    make_corpus $corpus
+}
+
+puts "Creating stub ..."
+::cookit::makestub $stub
+
+set fh [open [dict get $options -output] w]
+puts $fh [join {
+    compression pagesize smallfilesize smallfilebuffer
+    wall_ms cpu_ms rss_kb size run_ms script_warm_us binary_warm_us
+} \t]
+
+foreach compression [dict get $options -compression] {
+foreach pagesize [dict get $options -pagesize] {
+foreach smallfilesize [dict get $options -smallfilesize] {
+foreach smallfilebuffer [dict get $options -smallfilebuffer] {
+
+    set params [list $compression $pagesize $smallfilesize $smallfilebuffer]
+    puts -nonewline "Wrapping: $params ... "
+    flush stdout
+
+    file delete -force $output
+    if { [catch {
+        set stats [exec [info nameofexecutable] [info script] -child \
+            $corpus $stub $output {*}$params]
+        set start [clock milliseconds]
+        set reads [exec $output]
+        set run [expr { [clock milliseconds] - $start }]
+    } err] } {
+        set err [lindex [split [string trim $err] \n] 0]
+        puts $fh [join [list {*}$params failed "" "" "" "" "" $err] \t]
+        flush $fh
+        puts "failed: $err"
+        continue
+    }
+
+    set line [list {*}$params {*}$stats [file size $output] $run {*}$reads]
+    puts $fh [join $line \t]
+    flush $fh
+
+    puts "[lindex $stats 0] ms, [file size $output] bytes"
+
+}
+}
+}
+}
+
+close $fh
+file delete -force $output $stub
+
+if { $cleanup } {
+    file delete -force $workdir
+}
+
+puts "Results are saved to [dict get $options -output]"